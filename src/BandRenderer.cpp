@@ -0,0 +1,223 @@
+#include "BandRenderer.h"
+#include "Executor.h"
+#include "LoopKernel.h"
+#include <algorithm>
+#include <climits>
+#include <thread>
+
+BandRenderer::BandRenderer(Executor *executor, int threads, bool frontToBack)
+    : executor(executor), threads(threads), frontToBack(frontToBack) {
+}
+
+void BandRenderer::begin() {
+    if (frontToBack && !executor->svg && !executor->dryRun && !executor->recorder)
+        recording = wholeProgram = true;
+}
+
+void BandRenderer::end() {
+    recording = wholeProgram = false;
+    flush();
+}
+
+bool BandRenderer::run(const LoopKernel *kernel, int loops) {
+    if (wholeProgram || executor->svg || executor->dryRun || executor->recorder)
+        return kernel->run(executor, loops);
+    recording = true;
+    bool ran = kernel->run(executor, loops);
+    recording = false;
+    flush();
+    return ran;
+}
+
+// walk the pen over the line as strokeLine does and keep it for later
+void BandRenderer::record(int steps, int half, const Pixel *run) {
+    double dx = executor->headingCos();
+    double dy = executor->headingSin();
+    double x = executor->logical_pen_x;
+    double y = executor->logical_pen_y;
+    Line line = {x, y, dx, dy, steps, half, executor->penColor, run, checkpoints.size() / 2};
+    for (int i = 1; i <= steps; i++) {
+        x += dx;
+        y += dy;
+        if (i % CHECKPOINT == 0 && i < steps) {
+            checkpoints.push_back(x);
+            checkpoints.push_back(y);
+        }
+    }
+    executor->logical_pen_x = x;
+    executor->logical_pen_y = y;
+    lines.push_back(line);
+    pixels += static_cast<long>(steps) * (2 * half + 1) * (2 * half + 1);
+    if (lines.size() >= MAX_LINES)
+        flush();
+}
+
+void BandRenderer::recordLine(int steps) {
+    if (steps > MAX_STEPS) {
+        flush();
+        recording = false;
+        executor->drawLine(steps);
+        recording = true;
+        return;
+    }
+    record(steps, executor->penWidth / 2, nullptr);
+}
+
+// only called for pen width 1, wider pens draw a line per pixel
+void BandRenderer::recordRun(const Pixel *colors, size_t count) {
+    if (count > static_cast<size_t>(MAX_STEPS)) {
+        flush();
+        recording = false;
+        executor->drawPixelRun(colors, count);
+        recording = true;
+        return;
+    }
+    record(count, 0, colors);
+    executor->penColor = colors[count - 1];
+}
+
+// The buffer positions of the steps [first, first + points.size()) of a line
+// whose footprint can reach the band; they are placed exactly as the clipping
+// stroke kernel places them, walking from the nearest checkpoint.
+void BandRenderer::place(const Line &line, Band *band, int &first, std::vector<Point> &points) const {
+    int originX = executor->originX;
+    int originY = executor->originY;
+    int half = line.half;
+    int last = line.steps;
+    first = 0;
+    points.clear();
+    Executor::clipSteps(line.x, line.dx, originX - half - 2.0, originX + executor->width + half + 1.0, first, last);
+    Executor::clipSteps(line.y, line.dy, originY + band->row0 - half - 2.0, originY + band->row1 + half + 1.0, first, last);
+    if (last <= first)
+        return;
+    int i = first / CHECKPOINT * CHECKPOINT;
+    double x = line.x;
+    double y = line.y;
+    if (i > 0) {
+        size_t k = line.checkpoints + i / CHECKPOINT - 1;
+        x = checkpoints[2 * k];
+        y = checkpoints[2 * k + 1];
+    }
+    for (; i < first; i++) {
+        x += line.dx;
+        y += line.dy;
+    }
+    for (; i < last; i++) {
+        Point p = {static_cast<int>(x + 0.5) - originX, static_cast<int>(y + 0.5) - originY};
+        points.push_back(p);
+        x += line.dx;
+        y += line.dy;
+    }
+}
+
+// the part of the footprint of radius half at (x, y) inside the band, false if none
+static inline bool footprint(int x, int y, int half, int row0, int row1, int width, int &r0, int &r1, int &c0, int &c1) {
+    r0 = std::max(y - half, row0);
+    r1 = std::min(y + half, row1 - 1);
+    c0 = std::max(x - half, 0);
+    c1 = std::min(x + half, width - 1);
+    return r0 <= r1 && c0 <= c1;
+}
+
+// draw the lines into the rows of one band, in recording order
+void BandRenderer::rasterize(Band *band) const {
+    Pixel *pixels = reinterpret_cast<Pixel *>(executor->buffer);
+    int width = executor->width;
+    std::vector<Point> points;
+    for (auto it = lines.begin(); it != lines.end(); it++) {
+        int first;
+        place(*it, band, first, points);
+        for (size_t j = 0; j < points.size(); j++) {
+            int r0, r1, c0, c1;
+            if (!footprint(points[j].x, points[j].y, it->half, band->row0, band->row1, width, r0, r1, c0, c1))
+                continue;
+            Pixel color = it->run ? it->run[first + j] : it->color;
+            for (int r = r0; r <= r1; r++)
+                std::fill(pixels + r * width + c0, pixels + r * width + c1 + 1, color);
+            band->x0 = std::min(band->x0, c0);
+            band->y0 = std::min(band->y0, r0);
+            band->x1 = std::max(band->x1, c1);
+            band->y1 = std::max(band->y1, r1);
+            band->pixels += static_cast<unsigned long long>(r1 - r0 + 1) * (c1 - c0 + 1);
+        }
+    }
+}
+
+// Draw the lines into the rows of one band from the last step to the first,
+// storing only the pixels no later step has covered. Words of the mask whose
+// pixels are all covered skip 64 pixels at once, and once the whole band is
+// covered only the bounds and the pixel count are still kept.
+void BandRenderer::rasterizeReversed(Band *band) const {
+    Pixel *pixels = reinterpret_cast<Pixel *>(executor->buffer);
+    int width = executor->width;
+    size_t words = (width + 63) / 64;
+    std::vector<unsigned long long> mask(words * (band->row1 - band->row0), 0);
+    long uncovered = static_cast<long>(width) * (band->row1 - band->row0);
+    std::vector<Point> points;
+    for (auto it = lines.rbegin(); it != lines.rend(); it++) {
+        int first;
+        place(*it, band, first, points);
+        for (size_t j = points.size(); j-- > 0;) {
+            int r0, r1, c0, c1;
+            if (!footprint(points[j].x, points[j].y, it->half, band->row0, band->row1, width, r0, r1, c0, c1))
+                continue;
+            band->x0 = std::min(band->x0, c0);
+            band->y0 = std::min(band->y0, r0);
+            band->x1 = std::max(band->x1, c1);
+            band->y1 = std::max(band->y1, r1);
+            band->pixels += static_cast<unsigned long long>(r1 - r0 + 1) * (c1 - c0 + 1);
+            if (uncovered == 0)
+                continue;
+            Pixel color = it->run ? it->run[first + j] : it->color;
+            for (int r = r0; r <= r1; r++) {
+                unsigned long long *covered = mask.data() + (r - band->row0) * words;
+                Pixel *row = pixels + r * width;
+                for (int w = c0 >> 6; w <= c1 >> 6; w++) {
+                    unsigned long long bits = ~0ULL;
+                    if (w == c0 >> 6)
+                        bits &= ~0ULL << (c0 & 63);
+                    if (w == c1 >> 6)
+                        bits &= ~0ULL >> (63 - (c1 & 63));
+                    bits &= ~covered[w];
+                    if (!bits)
+                        continue;
+                    covered[w] |= bits;
+                    uncovered -= __builtin_popcountll(bits);
+                    for (; bits; bits &= bits - 1)
+                        row[w * 64 + __builtin_ctzll(bits)] = color;
+                }
+            }
+        }
+    }
+}
+
+void BandRenderer::flush() {
+    if (lines.empty())
+        return;
+    int count = pixels < MIN_PIXELS ? 1 : std::min(threads, executor->height);
+    std::vector<Band> bands(count);
+    for (int i = 0; i < count; i++) {
+        Band &band = bands[i];
+        band.row0 = static_cast<long>(executor->height) * i / count;
+        band.row1 = static_cast<long>(executor->height) * (i + 1) / count;
+        band.x0 = band.y0 = INT_MAX;
+        band.x1 = band.y1 = INT_MIN;
+        band.pixels = 0;
+    }
+    std::vector<std::thread> workers;
+    void (BandRenderer::*draw)(Band *) const = frontToBack ? &BandRenderer::rasterizeReversed : &BandRenderer::rasterize;
+    for (int i = 1; i < count; i++)
+        workers.push_back(std::thread(draw, this, &bands[i]));
+    (this->*draw)(&bands[0]);
+    for (size_t i = 0; i < workers.size(); i++)
+        workers[i].join();
+    for (int i = 0; i < count; i++) {
+        if (bands[i].pixels) {
+            executor->markDirty(bands[i].x0, bands[i].y0, bands[i].x1, bands[i].y1);
+            executor->pixelsDrawn += bands[i].pixels;
+        }
+    }
+    lines.clear();
+    checkpoints.clear();
+    pixels = 0;
+}
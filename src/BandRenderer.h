@@ -0,0 +1,76 @@
+#if !defined(BANDRENDERER_H)
+#define BANDRENDERER_H
+
+#include "Pixel.h"
+#include <cstddef>
+#include <vector>
+
+class Executor;
+class LoopKernel;
+
+// Runs compiled loops with their rasterization spread over several threads.
+// The iterations still run one after the other, but drawLine and drawPixelRun
+// only record what they would draw and walk the pen with the same additions,
+// so every iteration starts on exactly the pen position, heading, color and
+// variable values it would have. The recorded lines are then drawn by one
+// thread per band of buffer rows: each thread draws every line, in recording
+// order and clipped to its band, so where lines overlap the buffer ends up
+// exactly as when they are drawn one by one.
+// Front to back, the whole program is recorded and every batch is drawn in
+// reverse: a coverage mask with one bit per pixel of the band skips the pixels
+// a later step has already stored, so each pixel is stored once per batch.
+class BandRenderer {
+public:
+    static const size_t MAX_LINES = 1 << 16; // recorded lines are drawn in batches of at most this many
+    static const long MAX_STEPS = 1 << 20;   // longer lines are drawn as they are recorded
+    static const long MIN_PIXELS = 1 << 16;  // smaller batches are drawn on the calling thread
+    static const int CHECKPOINT = 64;        // a pen position is kept every CHECKPOINT steps of a line
+
+private:
+    struct Line {
+        double x, y; // pen position of the first step
+        double dx, dy;
+        int steps;
+        int half;           // pen radius
+        Pixel color;
+        const Pixel *run;   // one color per step, or nullptr
+        size_t checkpoints; // index of the position after CHECKPOINT steps
+    };
+    // buffer rows [row0, row1), and what a thread drew there
+    struct Band {
+        int row0, row1;
+        int x0, y0, x1, y1;
+        unsigned long long pixels;
+    };
+    struct Point {
+        int x, y;
+    };
+    Executor *executor;
+    int threads;
+    bool frontToBack;
+    bool recording = false;
+    bool wholeProgram = false; // recording from begin() to end()
+    std::vector<Line> lines;
+    std::vector<double> checkpoints; // x, y of every checkpoint
+    long pixels = 0;                  // footprint pixels of the recorded lines
+
+    void record(int steps, int half, const Pixel *run);
+    void flush();
+    void place(const Line &line, Band *band, int &first, std::vector<Point> &points) const;
+    void rasterize(Band *band) const;
+    void rasterizeReversed(Band *band) const;
+
+public:
+    BandRenderer(Executor *executor, int threads, bool frontToBack);
+    bool isRecording() const { return recording; }
+    // around a run of the program, recording all of it when front to back
+    void begin();
+    void end();
+    // run the loop as LoopKernel::run does, drawing in bands
+    bool run(const LoopKernel *kernel, int loops);
+    // drawLine and drawPixelRun while recording
+    void recordLine(int steps);
+    void recordRun(const Pixel *colors, size_t count);
+};
+
+#endif // BANDRENDERER_H
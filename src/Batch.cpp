@@ -0,0 +1,234 @@
+#include "Batch.h"
+#include "Interpreter.h"
+#include "Program.h"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+Batch::Batch(const Options &options) : options(options), left(0), pool(POOL_BYTES) {
+    this->options.quiet = true;
+}
+
+void Batch::add(const std::string &input, const std::string &output, const Options *options) {
+    Job job;
+    job.input = input;
+    job.output = output;
+    job.options = options ? *options : this->options;
+    jobs.push_back(job);
+}
+
+bool Batch::readManifest(const std::string &filename, std::string &error) {
+    std::ifstream in(filename);
+    if (!in) {
+        error = "cannot read " + filename;
+        return false;
+    }
+    std::string line;
+    for (int lineno = 1; std::getline(in, line); lineno++) {
+        std::istringstream fields(line);
+        std::vector<std::string> words;
+        std::string word;
+        while (fields >> word)
+            words.push_back(word);
+        if (words.empty() || words[0][0] == '#')
+            continue;
+        size_t next = 1;
+        std::string output;
+        if (next < words.size() && words[next][0] != '-')
+            output = words[next++];
+        std::vector<const char *> argv;
+        for (size_t i = next; i < words.size(); i++)
+            argv.push_back(words[i].c_str());
+        Options values = options;
+        for (int i = 0; i < static_cast<int>(argv.size()); i++) {
+            if (!values.parseOverride(i, argv.size(), argv.data())) {
+                error = filename + " line " + std::to_string(lineno) + ": unknown option " + argv[i];
+                return false;
+            }
+        }
+        add(words[0], output, &values);
+    }
+    return true;
+}
+
+size_t Batch::run(int threads) {
+    if (jobs.empty())
+        return 0;
+    size_t count = threads > 0 ? threads : std::thread::hardware_concurrency();
+    count = std::max<size_t>(std::min(count, jobs.size()), 1);
+    auto start = std::chrono::steady_clock::now();
+
+    // every worker starts with a contiguous share, in reverse so it takes them in order
+    workers.clear();
+    for (size_t w = 0; w < count; w++) {
+        workers.push_back(std::unique_ptr<Worker>(new Worker()));
+        size_t first = jobs.size() * w / count;
+        size_t last = jobs.size() * (w + 1) / count;
+        for (size_t i = last; i-- > first;) {
+            Task task = {i, COMPILE};
+            workers[w]->tasks.push_back(task);
+        }
+    }
+    shared.clear();
+    std::map<std::string, size_t> uses;
+    for (size_t i = 0; i < jobs.size(); i++)
+        uses[jobs[i].input]++;
+    for (size_t i = 0; i < jobs.size(); i++) {
+        Job &job = jobs[i];
+        job.shared = nullptr;
+        if (uses[job.input] < 2)
+            continue;
+        std::unique_ptr<Shared> &entry = shared[job.input];
+        if (!entry)
+            entry.reset(new Shared());
+        entry->users++;
+        job.shared = entry.get();
+    }
+    left = jobs.size();
+    finished = failed = 0;
+    pushed = 0;
+    std::vector<std::thread> threadList;
+    for (size_t w = 1; w < count; w++)
+        threadList.push_back(std::thread(&Batch::work, this, w));
+    work(0);
+    for (size_t i = 0; i < threadList.size(); i++)
+        threadList[i].join();
+
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "batch: " << jobs.size() - failed << " ok, " << failed << " failed, " << count << " threads, "
+              << pool.getReused() << " of " << pool.getReused() + pool.getAllocated() << " buffers reused, "
+              << std::fixed << std::setprecision(1) << ms << " ms" << std::endl;
+    return failed;
+}
+
+void Batch::work(size_t self) {
+    while (left > 0) {
+        size_t seen;
+        {
+            std::lock_guard<std::mutex> lock(idleMutex);
+            seen = pushed;
+        }
+        Task task;
+        if (take(self, task)) {
+            perform(self, task);
+            continue;
+        }
+        // the last jobs are running elsewhere: sleep until one of them has a
+        // next task to steal or the batch is done
+        std::unique_lock<std::mutex> lock(idleMutex);
+        idle.wait(lock, [&] { return pushed != seen || left == 0; });
+    }
+}
+
+// the newest task of this worker, or the oldest of another one
+bool Batch::take(size_t self, Task &task) {
+    {
+        Worker &own = *workers[self];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = own.tasks.back();
+            own.tasks.pop_back();
+            return true;
+        }
+    }
+    for (size_t i = 1; i < workers.size(); i++) {
+        Worker &victim = *workers[(self + i) % workers.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = victim.tasks.front();
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void Batch::push(size_t self, const Task &task) {
+    {
+        Worker &own = *workers[self];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        own.tasks.push_back(task);
+    }
+    {
+        std::lock_guard<std::mutex> lock(idleMutex);
+        pushed++;
+    }
+    idle.notify_one();
+}
+
+void Batch::perform(size_t self, const Task &task) {
+    Job &job = jobs[task.job];
+    auto start = std::chrono::steady_clock::now();
+    bool ok;
+    switch (task.stage) {
+    case COMPILE:
+        job.interpreter = new Interpreter();
+        job.interpreter->setOptions(job.options);
+        job.interpreter->setBufferPool(&pool);
+        if (job.shared) {
+            std::shared_ptr<const Program> program = compileShared(job);
+            // a program that does not compile is loaded as a file, for its error
+            if (program) {
+                ok = job.interpreter->load(*program, job.output.empty() ? nullptr : job.output.c_str());
+                break;
+            }
+        }
+        ok = job.interpreter->load(job.input.c_str(), job.output.empty() ? nullptr : job.output.c_str());
+        break;
+    case RUN:
+        ok = job.interpreter->render();
+        break;
+    default:
+        ok = job.interpreter->encode();
+        break;
+    }
+    job.ms[task.stage] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    if (ok && task.stage != ENCODE) {
+        Task next = {task.job, static_cast<Stage>(task.stage + 1)};
+        push(self, next);
+    } else {
+        finish(job, ok);
+    }
+}
+
+// the program of the job's input, compiled by the first job that asks for it;
+// it is released once every job of the input has its copy
+std::shared_ptr<const Program> Batch::compileShared(Job &job) {
+    Shared &entry = *job.shared;
+    std::lock_guard<std::mutex> lock(entry.mutex);
+    if (!entry.compiled) {
+        entry.compiled = true;
+        LogoError error("");
+        entry.program = Program::compileFile(job.input, error);
+    }
+    std::shared_ptr<const Program> program = entry.program;
+    if (--entry.users == 0)
+        entry.program.reset();
+    return program;
+}
+
+void Batch::finish(Job &job, bool ok) {
+    std::ostringstream line;
+    line << std::fixed << std::setprecision(2);
+    if (ok)
+        line << "ok " << job.input << " -> " << job.interpreter->getOutputName() << ": compile " << job.ms[COMPILE]
+             << " ms, run " << job.ms[RUN] << " ms, encode " << job.ms[ENCODE] << " ms";
+    else
+        line << "failed " << job.input << ": " << job.interpreter->getError().message;
+    delete job.interpreter;
+    job.interpreter = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(reportMutex);
+        finished++;
+        if (!ok)
+            failed++;
+        std::cout << "[" << finished << "/" << jobs.size() << "] " << line.str() << std::endl;
+    }
+    std::lock_guard<std::mutex> lock(idleMutex);
+    if (--left == 0)
+        idle.notify_all();
+}
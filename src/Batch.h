@@ -0,0 +1,90 @@
+#if !defined(BATCH_H)
+#define BATCH_H
+
+#include "BufferPool.h"
+#include "Options.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class Interpreter;
+class Program;
+
+// Renders many programs in one process. Every program is a job of three tasks,
+// compile (parse and check), run and encode, and each worker thread keeps a
+// deque of tasks: it takes its own from the back, so a job it started goes on
+// while its buffer is still in the cache, and when it runs out it steals from
+// the front of another worker's deque. Pixel buffers go back to a pool shared
+// by the workers for the next canvas of the same size. Jobs that render the
+// same input share one Program, compiled by the first of them and copied by
+// the others, each with the values of its own manifest line.
+// A job that fails is reported and the others go on.
+class Batch {
+public:
+    static const size_t POOL_BYTES = 256 << 20; // pixel buffers kept for reuse
+
+private:
+    enum Stage { COMPILE, RUN, ENCODE };
+    struct Task {
+        size_t job;
+        Stage stage;
+    };
+    struct Worker {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+    // the program of an input that several jobs render
+    struct Shared {
+        std::mutex mutex;
+        bool compiled = false;
+        std::shared_ptr<const Program> program; // nullptr on an error, each job then reports it
+        size_t users = 0;                       // jobs that have not compiled yet
+    };
+    struct Job {
+        std::string input;
+        std::string output; // empty: derived from the input as for a single file
+        Options options;    // with the values of the manifest line, see Options::parseOverride
+        Shared *shared = nullptr;
+        Interpreter *interpreter = nullptr;
+        double ms[3] = {0, 0, 0}; // time spent in each stage
+    };
+
+    Options options;
+    std::vector<Job> jobs;
+    std::map<std::string, std::unique_ptr<Shared>> shared; // by input file
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::atomic<size_t> left; // jobs not finished yet
+    std::mutex idleMutex;
+    std::condition_variable idle; // a task was pushed, or the last job finished
+    size_t pushed = 0;            // tasks pushed so far, under idleMutex
+    BufferPool pool;
+    std::mutex reportMutex;
+    size_t finished = 0;
+    size_t failed = 0;
+
+    void work(size_t self);
+    bool take(size_t self, Task &task);
+    void push(size_t self, const Task &task);
+    void perform(size_t self, const Task &task);
+    void finish(Job &job, bool ok);
+    std::shared_ptr<const Program> compileShared(Job &job);
+
+public:
+    explicit Batch(const Options &options);
+    void add(const std::string &input, const std::string &output = "", const Options *options = nullptr);
+    // one job per line: an input file, optionally its output file, then
+    // optionally the values to render it with (--set, --size, --background,
+    // --position); empty lines and lines starting with # are skipped. False
+    // with the reason in error if it cannot be read
+    bool readManifest(const std::string &filename, std::string &error);
+    size_t size() const { return jobs.size(); }
+    // render every job on threads workers, 0 for one per core; the number of failed jobs
+    size_t run(int threads);
+};
+
+#endif // BATCH_H
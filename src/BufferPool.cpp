@@ -0,0 +1,37 @@
+#include "BufferPool.h"
+
+BufferPool::BufferPool(size_t capacity) : capacity(capacity) {
+}
+
+BufferPool::~BufferPool() {
+    for (auto it = buffers.begin(); it != buffers.end(); it++)
+        delete[] it->second;
+}
+
+unsigned char *BufferPool::acquire(size_t bytes) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = buffers.find(bytes);
+        if (it != buffers.end()) {
+            unsigned char *buffer = it->second;
+            buffers.erase(it);
+            kept -= bytes;
+            reused++;
+            return buffer;
+        }
+        allocated++;
+    }
+    return new unsigned char[bytes];
+}
+
+void BufferPool::release(unsigned char *buffer, size_t bytes) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (kept + bytes <= capacity) {
+            buffers.insert(std::make_pair(bytes, buffer));
+            kept += bytes;
+            return;
+        }
+    }
+    delete[] buffer;
+}
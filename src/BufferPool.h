@@ -0,0 +1,30 @@
+#if !defined(BUFFERPOOL_H)
+#define BUFFERPOOL_H
+
+#include <cstddef>
+#include <map>
+#include <mutex>
+
+// Pixel buffers handed back by finished programs, kept for the next program
+// that renders a canvas of the same size. Shared by the threads of a batch.
+class BufferPool {
+private:
+    std::mutex mutex;
+    std::multimap<size_t, unsigned char *> buffers; // byte size, buffer
+    size_t capacity; // at most this many bytes are kept
+
+    size_t kept = 0;
+    unsigned long long reused = 0;
+    unsigned long long allocated = 0;
+
+public:
+    explicit BufferPool(size_t capacity);
+    ~BufferPool();
+    // a buffer of bytes bytes, with undefined contents
+    unsigned char *acquire(size_t bytes);
+    void release(unsigned char *buffer, size_t bytes);
+    unsigned long long getReused() const { return reused; }
+    unsigned long long getAllocated() const { return allocated; }
+};
+
+#endif // BUFFERPOOL_H
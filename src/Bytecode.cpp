@@ -0,0 +1,371 @@
+#include "Bytecode.h"
+#include "Function.h"
+#include "Interpreter.h"
+#include "Op.h"
+#include "Verifier.h"
+#include "utility.h"
+#include <cstdio>
+#include <cstring>
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static const char MAGIC[8] = {'L', 'O', 'G', 'O', 'C', '\0', '\r', '\n'};
+
+bool Bytecode::isBytecode(const char *filename) {
+    FILE *fp = fopen(filename, "rb");
+    if (fp == nullptr)
+        return false;
+    char head[sizeof(MAGIC)];
+    bool result = fread(head, 1, sizeof(head), fp) == sizeof(head) && !memcmp(head, MAGIC, sizeof(MAGIC));
+    fclose(fp);
+    return result;
+}
+
+int Bytecode::nameIndex(const std::string &name) {
+    auto it = nameIndexes.find(name);
+    if (it != nameIndexes.end())
+        return it->second;
+    names.push_back(name);
+    nameIndexes[name] = names.size() - 1;
+    return names.size() - 1;
+}
+
+void Bytecode::put(uint32_t word) {
+    for (int i = 0; i < 4; i++)
+        out.push_back(static_cast<char>(word >> (8 * i)));
+}
+
+void Bytecode::putOperand(const VariableWrapper &vw) {
+    put(vw.isVariable());
+    put(vw.isVariable() ? nameIndex(vw.getVariableName()) : vw.getLiteral());
+}
+
+void Bytecode::putOp(Op *op, const std::unordered_map<Op *, size_t> &positions, const std::unordered_map<Function *, size_t> &functions) {
+    int lineno = op->getLineNo();
+    if (MoveOp *move = dynamic_cast<MoveOp *>(op)) {
+        put(MOVE);
+        put(lineno);
+        putOperand(move->_varWrapper);
+    } else if (TurnOp *turn = dynamic_cast<TurnOp *>(op)) {
+        put(TURN);
+        put(lineno);
+        putOperand(turn->varWrapper);
+    } else if (dynamic_cast<CloakOp *>(op)) {
+        put(CLOAK);
+        put(lineno);
+    } else if (StartLoopOp *loop = dynamic_cast<StartLoopOp *>(op)) {
+        put(LOOP);
+        put(lineno);
+        put(loop->prop_loops);
+        put(positions.at(loop->end));
+    } else if (EndLoopOp *endLoop = dynamic_cast<EndLoopOp *>(op)) {
+        put(END_LOOP);
+        put(lineno);
+        put(positions.at(endLoop->start));
+    } else if (ColorOp *color = dynamic_cast<ColorOp *>(op)) {
+        put(COLOR);
+        put(lineno);
+        putOperand(color->r);
+        putOperand(color->g);
+        putOperand(color->b);
+    } else if (AddOp *add = dynamic_cast<AddOp *>(op)) {
+        put(ADD);
+        put(lineno);
+        putOperand(add->var);
+        putOperand(add->value);
+    } else if (CallOp *call = dynamic_cast<CallOp *>(op)) {
+        put(CALL);
+        put(lineno);
+        put(nameIndex(call->name));
+        put(functions.at(call->target));
+        put(call->argList.size());
+        for (size_t i = 0; i < call->argList.size(); i++)
+            putOperand(call->argList[i]);
+    } else if (DefOp *def = dynamic_cast<DefOp *>(op)) {
+        put(DEF);
+        put(lineno);
+        put(nameIndex(def->name));
+        putOperand(def->varWrapper);
+    } else if (SetPenWidthOp *width = dynamic_cast<SetPenWidthOp *>(op)) {
+        put(PEN_WIDTH);
+        put(lineno);
+        putOperand(width->varWrapper);
+    } else if (dynamic_cast<FillOp *>(op)) {
+        put(FILL);
+        put(lineno);
+    } else {
+        // the optimized forms are built again by the Optimizer of the run
+        throw LogoError("Error: " + op->OpName() + " cannot be written as bytecode");
+    }
+}
+
+bool Bytecode::write(const std::string &filename) {
+    Interpreter &in = *interpreter;
+    std::vector<Function *> &functions = in.executor.allFunctions;
+    std::unordered_map<Function *, size_t> functionIndexes;
+    for (size_t f = 0; f < functions.size(); f++)
+        functionIndexes[functions[f]] = f;
+
+    // the functions first, they fill the name table
+    out.clear();
+    put(functions.size());
+    for (size_t f = 0; f < functions.size(); f++) {
+        Function *function = functions[f];
+        put(nameIndex(function->getName()));
+        std::vector<VariableWrapper> &paraList = function->getParaList();
+        put(paraList.size());
+        for (size_t i = 0; i < paraList.size(); i++)
+            put(nameIndex(paraList[i].getVariableName()));
+        std::vector<Op *> &ops = *function->getOps();
+        std::unordered_map<Op *, size_t> positions;
+        for (size_t i = 0; i < ops.size(); i++)
+            positions[ops[i]] = i;
+        put(ops.size());
+        for (size_t i = 0; i < ops.size(); i++)
+            putOp(ops[i], positions, functionIndexes);
+    }
+    std::string body;
+    body.swap(out);
+
+    out.append(MAGIC, sizeof(MAGIC));
+    put(VERSION);
+    put(in.autoSize);
+    put(in.autoSizeLine);
+    put(in.width);
+    put(in.height);
+    put(in.backgroundR);
+    put(in.backgroundG);
+    put(in.backgroundB);
+    put(in.startX);
+    put(in.startY);
+    put(in.executor.lastLine);
+    put(names.size());
+    for (size_t i = 0; i < names.size(); i++) {
+        put(names[i].size());
+        out += names[i];
+    }
+    out += body;
+
+    FILE *fp = fopen(filename.c_str(), "wb");
+    if (fp == nullptr)
+        return false;
+    bool ok = fwrite(out.data(), 1, out.size(), fp) == out.size();
+    return fclose(fp) == 0 && ok;
+}
+
+void Bytecode::invalid() {
+    throw LogoError("Error: the file is not valid bytecode");
+}
+
+uint32_t Bytecode::get() {
+    if (end - cursor < 4)
+        invalid();
+    uint32_t word = cursor[0] | cursor[1] << 8 | cursor[2] << 16 | static_cast<uint32_t>(cursor[3]) << 24;
+    cursor += 4;
+    return word;
+}
+
+const std::string &Bytecode::getName() {
+    uint32_t index = get();
+    if (index >= readNames.size())
+        invalid();
+    return readNames[index];
+}
+
+const VariableWrapper &Bytecode::getVariable() {
+    uint32_t index = get();
+    if (index >= readVariables.size())
+        invalid();
+    return readVariables[index];
+}
+
+VariableWrapper Bytecode::getOperand() {
+    if (get())
+        return getVariable();
+    return VariableWrapper(getInt());
+}
+
+void Bytecode::read(const char *filename) {
+#if defined(__unix__) || defined(__APPLE__)
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        throw LogoError("Cannot open the file", true);
+    }
+    struct stat info;
+    void *data = MAP_FAILED;
+    size_t size = 0;
+    if (fstat(fd, &info) == 0 && info.st_size > 0) {
+        size = info.st_size;
+        data = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (data == MAP_FAILED) {
+        invalid();
+    }
+    try {
+        decode(static_cast<const unsigned char *>(data), size);
+    } catch (...) {
+        munmap(data, size);
+        throw;
+    }
+    munmap(data, size);
+#else
+    FILE *fp = fopen(filename, "rb");
+    if (fp == nullptr) {
+        throw LogoError("Cannot open the file", true);
+    }
+    std::string data;
+    char chunk[1 << 16];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), fp)) > 0)
+        data.append(chunk, n);
+    fclose(fp);
+    decode(reinterpret_cast<const unsigned char *>(data.data()), data.size());
+#endif
+}
+
+// Ops go into their function as soon as they are built, so the Executor owns
+// them when the file turns out to be invalid halfway through.
+void Bytecode::decode(const unsigned char *data, size_t size) {
+    cursor = data;
+    end = data + size;
+    if (size < sizeof(MAGIC) || memcmp(data, MAGIC, sizeof(MAGIC)))
+        invalid();
+    cursor += sizeof(MAGIC);
+    uint32_t version = get();
+    if (version != VERSION) {
+        throw LogoError("Error: the file is bytecode version " + std::to_string(version) + ", this compiler reads version " +
+                        std::to_string(VERSION));
+    }
+    Interpreter &in = *interpreter;
+    Executor &executor = in.executor;
+    in.autoSize = get() != 0;
+    in.autoSizeLine = getInt();
+    in.width = getInt();
+    in.height = getInt();
+    in.backgroundR = getInt();
+    in.backgroundG = getInt();
+    in.backgroundB = getInt();
+    in.startX = getInt();
+    in.startY = getInt();
+    executor.lastLine = getInt();
+
+    uint32_t count = get();
+    if (count > static_cast<size_t>(end - cursor) / 4)
+        invalid();
+    readNames.reserve(count);
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t length = get();
+        if (length > static_cast<size_t>(end - cursor))
+            invalid();
+        readNames.push_back(std::string(reinterpret_cast<const char *>(cursor), length));
+        readVariables.push_back(VariableWrapper(readNames.back()));
+        cursor += length;
+    }
+
+    // calls are linked once every function exists
+    std::vector<std::pair<CallOp *, uint32_t>> calls;
+    uint32_t functions = get();
+    if (functions == 0)
+        invalid();
+    for (uint32_t f = 0; f < functions; f++) {
+        const std::string &name = getName();
+        uint32_t params = get();
+        std::vector<VariableWrapper> paraList;
+        for (uint32_t i = 0; i < params; i++)
+            paraList.push_back(getVariable());
+        Function *function = executor.allFunctions[0];
+        if (f == 0) {
+            if (name != function->getName() || params != 0)
+                invalid();
+        } else {
+            function = new Function(name, paraList);
+            executor.allFunctions.push_back(function);
+        }
+        std::vector<Op *> &ops = *function->getOps();
+        std::vector<std::pair<StartLoopOp *, uint32_t>> loops; // open, with the index of their END LOOP
+        uint32_t length = get();
+        for (uint32_t i = 0; i < length; i++) {
+            uint32_t kind = get();
+            int lineno = getInt();
+            Op *op = nullptr;
+            if (kind == MOVE) {
+                op = new MoveOp(&executor, getOperand(), lineno);
+            } else if (kind == TURN) {
+                op = new TurnOp(&executor, getOperand(), lineno);
+            } else if (kind == CLOAK) {
+                op = new CloakOp(&executor, lineno);
+            } else if (kind == LOOP) {
+                int loopCount = getInt();
+                uint32_t endIndex = get();
+                StartLoopOp *loop = new StartLoopOp(&executor, loopCount, lineno);
+                loops.push_back(std::make_pair(loop, endIndex));
+                op = loop;
+            } else if (kind == END_LOOP) {
+                uint32_t start = get();
+                if (loops.empty() || loops.back().second != i || start >= ops.size() || ops[start] != loops.back().first)
+                    invalid();
+                op = new EndLoopOp(&executor, loops.back().first, lineno);
+                loops.back().first->setEndLoopOp(op);
+                loops.pop_back();
+            } else if (kind == COLOR) {
+                VariableWrapper r = getOperand();
+                VariableWrapper g = getOperand();
+                VariableWrapper b = getOperand();
+                op = new ColorOp(&executor, r, g, b, lineno);
+            } else if (kind == ADD) {
+                VariableWrapper var = getOperand();
+                VariableWrapper value = getOperand();
+                if (!var.isVariable())
+                    invalid();
+                op = new AddOp(&executor, var, value, lineno);
+            } else if (kind == CALL) {
+                const std::string &callee = getName();
+                uint32_t target = get();
+                uint32_t args = get();
+                std::vector<VariableWrapper> argList;
+                for (uint32_t k = 0; k < args; k++)
+                    argList.push_back(getOperand());
+                CallOp *call = new CallOp(&executor, callee, argList, lineno);
+                calls.push_back(std::make_pair(call, target));
+                op = call;
+            } else if (kind == DEF) {
+                const std::string &var = getName();
+                VariableWrapper value = getOperand();
+                // as Interpreter::processSymbol does for the program text
+                if (f == 0) {
+                    in.parameters.insert(var);
+                    auto override = in.options.values.find(var);
+                    if (override != in.options.values.end())
+                        value = VariableWrapper(override->second);
+                }
+                op = new DefOp(&executor, var, value, lineno);
+            } else if (kind == PEN_WIDTH) {
+                op = new SetPenWidthOp(&executor, getOperand(), lineno);
+            } else if (kind == FILL) {
+                op = new FillOp(&executor, lineno);
+            } else {
+                invalid();
+            }
+            ops.push_back(op);
+        }
+        if (!loops.empty())
+            invalid();
+    }
+    if (cursor != end)
+        invalid();
+    for (size_t i = 0; i < calls.size(); i++) {
+        if (calls[i].second >= executor.allFunctions.size())
+            invalid();
+        calls[i].first->target = executor.allFunctions[calls[i].second];
+    }
+
+    Verifier verifier(&executor);
+    std::string report;
+    if (!verifier.verify(report))
+        throw LogoError(report);
+}
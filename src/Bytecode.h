@@ -0,0 +1,71 @@
+#if !defined(BYTECODE_H)
+#define BYTECODE_H
+
+#include "VariableWrapper.h"
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class Function;
+class Interpreter;
+class Op;
+
+// The parsed program in a binary file (--emit-bytecode), which load() reads
+// back in place of the program text. The file is position independent: ops
+// refer to names, functions and loop ends by index. Little-endian words:
+//   header:    "LOGOC\0\r\n", version, then @SIZE (auto, line, width, height),
+//              @BACKGROUND (r, g, b), @POSITION (x, y) and the last line
+//   names:     count, then each one as a length and its bytes
+//   functions: count, then each one as name, parameter count, parameters
+//              (names), op count and the ops
+//   op:        kind, line, then its operands; an operand is a flag (1: a
+//              name) and the literal or the name; a LOOP has the index of
+//              its END LOOP, an END LOOP the index of its LOOP, a CALL the
+//              name and index of the function it calls and its arguments
+// The file is mapped, not read, so processes loading the same one share its
+// pages; the ops are built from it in one pass and proven by the Verifier
+// again, as the file may not come from this version of the compiler.
+class Bytecode {
+public:
+    static const uint32_t VERSION = 1;
+
+private:
+    enum Kind { MOVE, TURN, CLOAK, LOOP, END_LOOP, COLOR, ADD, CALL, DEF, PEN_WIDTH, FILL };
+    Interpreter *interpreter;
+
+    // writing
+    std::vector<std::string> names;
+    std::map<std::string, int> nameIndexes;
+    std::string out;
+    int nameIndex(const std::string &name);
+    void put(uint32_t word);
+    void putOperand(const VariableWrapper &vw);
+    void putOp(Op *op, const std::unordered_map<Op *, size_t> &positions, const std::unordered_map<Function *, size_t> &functions);
+
+    // reading
+    const unsigned char *cursor = nullptr;
+    const unsigned char *end = nullptr;
+    std::vector<std::string> readNames;
+    std::vector<VariableWrapper> readVariables; // of every name, interned once
+    uint32_t get();
+    int getInt() { return static_cast<int>(get()); }
+    const std::string &getName();
+    const VariableWrapper &getVariable(); // the name as an operand
+    VariableWrapper getOperand();
+    void decode(const unsigned char *data, size_t size);
+    void invalid();
+
+public:
+    explicit Bytecode(Interpreter *interpreter) : interpreter(interpreter) {}
+    // whether the file starts like a bytecode file
+    static bool isBytecode(const char *filename);
+    // the program the interpreter has read, before optimization; false if the file cannot be written
+    bool write(const std::string &filename);
+    // read the program in place of Interpreter::readProgram; throws a LogoError
+    void read(const char *filename);
+};
+
+#endif // BYTECODE_H
@@ -0,0 +1,407 @@
+#include "CallCuller.h"
+#include "Executor.h"
+#include "Function.h"
+#include "Op.h"
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+bool CallCuller::Key::operator<(const Key &other) const {
+    if (argc != other.argc)
+        return argc < other.argc;
+    for (int i = 0; i < argc; i++) {
+        if (args[i] != other.args[i])
+            return args[i] < other.args[i];
+    }
+    if (degree != other.degree)
+        return degree < other.degree;
+    if (penWidth != other.penWidth)
+        return penWidth < other.penWidth;
+    return clocked < other.clocked;
+}
+
+CallCuller::CallCuller(Executor *executor) : executor(executor) {
+}
+
+CallCuller::~CallCuller() {
+    for (auto it = tables.begin(); it != tables.end(); it++) {
+        for (auto s = it->second.summaries.begin(); s != it->second.summaries.end(); s++)
+            delete s->second;
+    }
+}
+
+// the binding of symbol in the frames of the summarized call, nullptr if it is
+// bound outside of it (or nowhere); same search order as Executor::getVariableBySymbol
+int *CallCuller::lookup(int symbol) {
+    for (size_t f = frameBases.size(); f-- > evalFloor;) {
+        size_t end = f + 1 < frameBases.size() ? frameBases[f + 1] : bindings.size();
+        for (size_t i = frameBases[f]; i < end; i++) {
+            if (bindings[i].first == symbol)
+                return &bindings[i].second;
+        }
+    }
+    return nullptr;
+}
+
+bool CallCuller::read(const VariableWrapper &vw, int &value) {
+    if (vw.isLiteral()) {
+        value = vw.getLiteral();
+        return true;
+    }
+    int *binding = lookup(vw.getSymbol());
+    if (!binding)
+        return false;
+    value = *binding;
+    return true;
+}
+
+void CallCuller::include(Summary *summary, double x0, double y0, double x1, double y1) {
+    summary->draws = true;
+    summary->x0 = std::min(summary->x0, x0);
+    summary->y0 = std::min(summary->y0, y0);
+    summary->x1 = std::max(summary->x1, x1);
+    summary->y1 = std::max(summary->y1, y1);
+}
+
+void CallCuller::includePath(Summary *summary, double x, double y) {
+    summary->px0 = std::min(summary->px0, x);
+    summary->py0 = std::min(summary->py0, y);
+    summary->px1 = std::max(summary->px1, x);
+    summary->py1 = std::max(summary->py1, y);
+}
+
+// a MOVE of steps > 0 with the pen down, or a pixel run of steps colors
+void CallCuller::walk(Summary *summary, int steps, const std::vector<Pixel> *run) {
+    double cx = Executor::degreeCos(summary->degree);
+    double cy = Executor::degreeSin(summary->degree);
+    double half = summary->penWidth / 2;
+    double ex = summary->dx + (steps - 1) * cx;
+    double ey = summary->dy + (steps - 1) * cy;
+    include(summary, std::min(summary->dx, ex) - half, std::min(summary->dy, ey) - half,
+            std::max(summary->dx, ex) + half, std::max(summary->dy, ey) + half);
+    // consecutive walks in one direction with one pen are the same additions
+    // and the same footprints as one longer walk
+    std::vector<Segment> &segments = summary->segments;
+    if (!run && !segments.empty() && segments.back().kind == Segment::WALK && !segments.back().run &&
+        segments.back().degree == summary->degree && segments.back().penWidth == summary->penWidth &&
+        segments.back().hasColor == summary->colorSet &&
+        (!summary->colorSet || (segments.back().color.r == summary->color.r && segments.back().color.g == summary->color.g &&
+                                segments.back().color.b == summary->color.b))) {
+        segments.back().steps += steps;
+    } else {
+        Segment segment = {Segment::WALK, summary->degree, steps, nullptr, summary->penWidth, summary->colorSet, summary->color, run};
+        segments.push_back(segment);
+    }
+    summary->dx += steps * cx;
+    summary->dy += steps * cy;
+    includePath(summary, summary->dx, summary->dy);
+    int side = summary->penWidth / 2 * 2 + 1;
+    summary->pixels += static_cast<unsigned long long>(steps) * side * side;
+}
+
+void CallCuller::compose(Summary *summary, const Summary *call) {
+    if (call->draws)
+        include(summary, summary->dx + call->x0, summary->dy + call->y0, summary->dx + call->x1, summary->dy + call->y1);
+    includePath(summary, summary->dx + call->px0, summary->dy + call->py0);
+    includePath(summary, summary->dx + call->px1, summary->dy + call->py1);
+    // the callee draws with the color set before the call until it sets its own
+    Segment segment = {Segment::CALL, 0, 0, call, 0, summary->colorSet, summary->color, nullptr};
+    summary->segments.push_back(segment);
+    summary->dx += call->dx;
+    summary->dy += call->dy;
+    summary->pixels += call->pixels;
+    summary->degree = call->degree;
+    summary->penWidth = call->penWidth;
+    summary->clocked = call->clocked;
+    if (call->colorSet) {
+        summary->colorSet = true;
+        summary->color = call->color;
+    }
+}
+
+// The summary of a call with key, built on first use; nullptr if the
+// function cannot be summarized, or while it is being built (recursion).
+const CallCuller::Summary *CallCuller::summarize(Function *function, const Key &key, long &budget) {
+    Table &table = tables[function];
+    if (table.disabled)
+        return nullptr;
+    auto it = table.summaries.find(key);
+    if (it != table.summaries.end())
+        return it->second;
+    if (table.summaries.size() >= MAX_SUMMARIES || evalDepth >= MAX_DEPTH)
+        return nullptr;
+    table.summaries[key] = nullptr;
+
+    Summary *summary = new Summary();
+    summary->x0 = summary->y0 = std::numeric_limits<double>::max();
+    summary->x1 = summary->y1 = -std::numeric_limits<double>::max();
+    summary->px0 = summary->py0 = summary->px1 = summary->py1 = 0;
+    summary->degree = key.degree;
+    summary->penWidth = key.penWidth;
+    summary->clocked = key.clocked;
+
+    // the call sees its own frame only
+    size_t floor = evalFloor;
+    size_t frames = frameBases.size();
+    size_t bound = bindings.size();
+    evalFloor = frames;
+    frameBases.push_back(bindings.size());
+    std::vector<VariableWrapper> &paraList = function->getParaList();
+    for (int i = 0; i < key.argc; i++)
+        bindings.push_back(std::make_pair(paraList[i].getSymbol(), key.args[i]));
+    evalDepth++;
+    std::vector<Op *> &ops = *function->getOps();
+    bool ok = evalOps(ops, 0, ops.size(), summary, budget);
+    evalDepth--;
+    // a failed evaluation can leave the frames of its callees
+    bindings.resize(bound);
+    frameBases.resize(frames);
+    evalFloor = floor;
+
+    if (!ok) {
+        delete summary;
+        table.summaries.erase(key);
+        table.disabled = true;
+        return nullptr;
+    }
+    table.summaries[key] = summary;
+    return summary;
+}
+
+// a call whose frame is the top one, with its arguments bound
+bool CallCuller::evalCall(Function *function, Summary *summary, long &budget) {
+    size_t argc = bindings.size() - frameBases.back();
+    if (argc <= MAX_ARGS) {
+        Key key;
+        memset(&key, 0, sizeof(key));
+        for (size_t i = 0; i < argc; i++)
+            key.args[i] = bindings[frameBases.back() + i].second;
+        key.argc = argc;
+        key.degree = summary->degree;
+        key.penWidth = summary->penWidth;
+        key.clocked = summary->clocked;
+        if (const Summary *call = summarize(function, key, budget)) {
+            compose(summary, call);
+            return true;
+        }
+        if (budget < 0)
+            return false;
+    }
+    // reads names of its callers, evaluated in place
+    if (evalDepth >= MAX_DEPTH)
+        return false;
+    evalDepth++;
+    std::vector<Op *> &ops = *function->getOps();
+    bool ok = evalOps(ops, 0, ops.size(), summary, budget);
+    evalDepth--;
+    return ok;
+}
+
+// Evaluate ops [begin, end) the way the Executor runs them, into summary.
+// false if the result would depend on anything outside of the call.
+bool CallCuller::evalOps(std::vector<Op *> &ops, size_t begin, size_t end, Summary *summary, long &budget) {
+    for (size_t i = begin; i < end; i++) {
+        if (--budget < 0)
+            return false;
+        Op *op = ops[i];
+        if (StartLoopOp *loop = dynamic_cast<StartLoopOp *>(op)) {
+            size_t last = i + 1;
+            while (last < end && ops[last] != loop->end)
+                last++;
+            if (last == end)
+                return false;
+            for (int k = 0; k < loop->prop_loops; k++) {
+                if (!evalOps(ops, i + 1, last, summary, budget))
+                    return false;
+            }
+            i = last;
+        } else if (MoveOp *move = dynamic_cast<MoveOp *>(op)) {
+            int steps;
+            if (!read(move->_varWrapper, steps))
+                return false;
+            if (summary->clocked) {
+                // one multiplication, as Executor::moveTurtle does
+                Segment segment = {Segment::CLOAK, summary->degree, steps, nullptr, 0, false, Pixel(), nullptr};
+                summary->segments.push_back(segment);
+                summary->dx += steps * Executor::degreeCos(summary->degree);
+                summary->dy += steps * Executor::degreeSin(summary->degree);
+                includePath(summary, summary->dx, summary->dy);
+            } else if (steps > 0) {
+                walk(summary, steps);
+            }
+        } else if (TurnOp *turn = dynamic_cast<TurnOp *>(op)) {
+            int degrees;
+            if (!read(turn->varWrapper, degrees))
+                return false;
+            summary->degree -= degrees;
+            summary->degree = (summary->degree + 360) % 360;
+        } else if (ColorOp *color = dynamic_cast<ColorOp *>(op)) {
+            int r, g, b;
+            if (!read(color->r, r) || !read(color->g, g) || !read(color->b, b))
+                return false;
+            if (r > 255 || g > 255 || b > 255 || r < 0 || g < 0 || b < 0)
+                return false; // warns
+            summary->colorSet = true;
+            summary->color = Pixel(r, g, b, 1);
+            summary->clocked = false;
+        } else if (op->isCloakOp()) {
+            summary->clocked = true;
+        } else if (SetPenWidthOp *width = dynamic_cast<SetPenWidthOp *>(op)) {
+            int w;
+            if (!read(width->varWrapper, w) || w <= 0)
+                return false;
+            summary->penWidth = w;
+        } else if (AddOp *add = dynamic_cast<AddOp *>(op)) {
+            int *binding = lookup(add->var.getSymbol());
+            int value;
+            if (!binding || !read(add->value, value))
+                return false;
+            *binding += value;
+        } else if (DefOp *def = dynamic_cast<DefOp *>(op)) {
+            int value;
+            if (!read(def->varWrapper, value))
+                return false;
+            bindings.push_back(std::make_pair(def->symbol, value));
+        } else if (CallOp *call = dynamic_cast<CallOp *>(op)) {
+            Function *callee = call->target;
+            std::vector<VariableWrapper> &paraList = callee->getParaList();
+            // the frame is visible while the arguments are read, as in CallOp::exec
+            frameBases.push_back(bindings.size());
+            for (size_t k = 0; k < call->argList.size(); k++) {
+                int value;
+                if (!read(call->argList[k], value))
+                    return false;
+                bindings.push_back(std::make_pair(paraList[k].getSymbol(), value));
+            }
+            if (!evalCall(callee, summary, budget))
+                return false;
+            bindings.resize(frameBases.back());
+            frameBases.pop_back();
+        } else if (InlineCallOp *call = dynamic_cast<InlineCallOp *>(op)) {
+            Function *callee = call->function;
+            std::vector<VariableWrapper> &paraList = callee->getParaList();
+            frameBases.push_back(bindings.size());
+            for (size_t k = 0; k < call->argList.size(); k++) {
+                int value;
+                if (!read(call->argList[k], value))
+                    return false;
+                bindings.push_back(std::make_pair(paraList[k].getSymbol(), value));
+            }
+            if (i + call->bodyLength + 1 >= end)
+                return false;
+            // the inlined body and its InlineReturnOp run as one call
+            if (!evalCall(callee, summary, budget))
+                return false;
+            bindings.resize(frameBases.back());
+            frameBases.pop_back();
+            i += call->bodyLength + 1;
+        } else if (PixelRunOp *run = dynamic_cast<PixelRunOp *>(op)) {
+            if (run->size() == 0)
+                continue;
+            summary->clocked = false;
+            walk(summary, run->size(), &run->getColors());
+            summary->colorSet = true;
+            summary->color = run->getColors().back();
+        } else {
+            // FILL prints, anything else is not known here
+            return false;
+        }
+    }
+    return true;
+}
+
+bool CallCuller::misses(const Summary *summary) const {
+    if (!summary->draws)
+        return true;
+    // two pixels of slack cover the rounding of the pen positions
+    double x = executor->logical_pen_x;
+    double y = executor->logical_pen_y;
+    return x + summary->x1 + 2 < executor->originX || x + summary->x0 - 2 >= executor->originX + executor->width ||
+           y + summary->y1 + 2 < executor->originY || y + summary->y0 - 2 >= executor->originY + executor->height;
+}
+
+// move the turtle exactly as running the body would
+void CallCuller::replay(const Summary *summary, bool draw) {
+    for (auto it = summary->segments.begin(); it != summary->segments.end(); it++) {
+        if (it->kind == Segment::CALL) {
+            if (draw && it->hasColor)
+                executor->penColor = it->color;
+            replay(it->call, draw);
+            continue;
+        }
+        double cx = Executor::degreeCos(it->degree);
+        double cy = Executor::degreeSin(it->degree);
+        if (it->kind == Segment::CLOAK) {
+            executor->logical_pen_x += it->steps * cx;
+            executor->logical_pen_y += it->steps * cy;
+            continue;
+        }
+        if (draw) {
+            executor->degree = it->degree;
+            executor->penWidth = it->penWidth;
+            if (it->run) {
+                executor->drawPixelRun(it->run->data(), it->run->size());
+                continue;
+            }
+            if (it->hasColor)
+                executor->penColor = it->color;
+            executor->drawLine(it->steps);
+            continue;
+        }
+        double x = executor->logical_pen_x;
+        double y = executor->logical_pen_y;
+        for (int i = 0; i < it->steps; i++) {
+            x += cx;
+            y += cy;
+        }
+        executor->logical_pen_x = x;
+        executor->logical_pen_y = y;
+    }
+}
+
+// the summary of the call whose frame the executor has just pushed
+const CallCuller::Summary *CallCuller::summarizeTop(Function *function) {
+    size_t argc = function->getParaList().size();
+    if (argc > MAX_ARGS)
+        return nullptr;
+    Key key;
+    memset(&key, 0, sizeof(key));
+    size_t base = executor->callStack.back().base;
+    for (size_t i = 0; i < argc; i++)
+        key.args[i] = executor->variables[base + i].getValue();
+    key.argc = argc;
+    key.degree = executor->degree;
+    key.penWidth = executor->penWidth;
+    key.clocked = executor->clocked;
+    long budget = EVAL_BUDGET;
+    return summarize(function, key, budget);
+}
+
+bool CallCuller::cull(Function *function) {
+    if (executor->svg || executor->dryRun || executor->recorder || verbose)
+        return false;
+    Table &table = tables[function];
+    if (table.disabled || ++table.calls < HOT_CALLS)
+        return false;
+    size_t argc = function->getParaList().size();
+    if (argc > MAX_ARGS) {
+        table.disabled = true;
+        return false;
+    }
+    const Summary *summary = summarizeTop(function);
+    if (!summary || !misses(summary))
+        return false;
+
+    // --max-pixels counts what the body would draw, inside the buffer or not,
+    // so that culling does not change whether a program is over the limit
+    if (executor->maxPixels)
+        executor->chargePixels(summary->pixels);
+    replay(summary);
+    executor->degree = summary->degree;
+    executor->penWidth = summary->penWidth;
+    executor->clocked = summary->clocked;
+    if (summary->colorSet)
+        executor->penColor = summary->color;
+    culled++;
+    return true;
+}
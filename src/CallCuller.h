@@ -0,0 +1,113 @@
+#if !defined(CALLCULLER_H)
+#define CALLCULLER_H
+
+#include "Pixel.h"
+#include <cstddef>
+#include <map>
+#include <utility>
+#include <vector>
+
+class Executor;
+class Function;
+class Op;
+class VariableWrapper;
+
+// Skips the body of calls that draw nothing inside the pixel buffer.
+// For a Function, its arguments and the pen state it is entered with
+// (heading, pen width, cloak), a summary records the box around everything
+// the body draws, relative to the start position, and how it moves the turtle.
+// Control flow only depends on literal loop counts, so the summary holds for
+// every call with the same key. When the box placed at the pen position misses
+// the buffer, the call is replaced by the summary: its walks are replayed as
+// the same additions the drawing code would make, so the turtle ends on exactly
+// the same position, and the pen state is set to what the body leaves.
+// Bodies that read or ADD names bound outside of the call, or that warn, fail
+// or print, are never summarized.
+class CallCuller {
+    friend class StampCache;
+
+public:
+    // summaries are built once a function has been called this often
+    static const long HOT_CALLS = 8;
+    static const size_t MAX_ARGS = 4;
+    // ops evaluated to build one summary, including the summaries of callees
+    static const long EVAL_BUDGET = 1 << 20;
+    static const size_t MAX_SUMMARIES = 4096; // per function
+
+private:
+    struct Key {
+        int args[MAX_ARGS];
+        int argc;
+        int degree;
+        int penWidth;
+        bool clocked;
+        bool operator<(const Key &other) const;
+    };
+    struct Summary;
+    struct Segment {
+        enum Kind { WALK, CLOAK, CALL };
+        Kind kind;
+        int degree;
+        int steps;
+        const Summary *call;
+        // how a WALK draws: pen width, pen color (unless it is still the one the
+        // call was entered with), or one color per step for a pixel run; for a
+        // CALL the color it is entered with, if the caller set one
+        int penWidth;
+        bool hasColor;
+        Pixel color;
+        const std::vector<Pixel> *run;
+    };
+    struct Summary {
+        std::vector<Segment> segments;
+        bool draws = false;
+        double x0, y0, x1, y1; // pen footprints of the drawing steps, relative to the start
+        double px0, py0, px1, py1; // every pen position, drawing or not, relative to the start
+        double dx = 0, dy = 0; // displacement, only used to place the boxes of callees
+        unsigned long long pixels = 0; // pen footprints of the drawing steps, as --max-pixels counts them
+        // pen state at the end
+        int degree;
+        int penWidth;
+        bool clocked;
+        bool colorSet = false;
+        Pixel color;
+    };
+    struct Table {
+        long calls = 0;
+        bool disabled = false;
+        std::map<Key, Summary *> summaries; // nullptr while being built
+    };
+    Executor *executor;
+    std::map<Function *, Table> tables;
+    // bindings of the frames of the evaluated calls, the top frame last
+    std::vector<std::pair<int, int>> bindings;
+    std::vector<size_t> frameBases;
+    size_t evalFloor = 0; // the frame of the summarized call, lookups stop there
+    int evalDepth = 0;
+    static const int MAX_DEPTH = 256; // nested calls evaluated for one summary
+    long culled = 0;
+
+    const Summary *summarize(Function *function, const Key &key, long &budget);
+    bool evalOps(std::vector<Op *> &ops, size_t begin, size_t end, Summary *summary, long &budget);
+    bool evalCall(Function *function, Summary *summary, long &budget);
+    void compose(Summary *summary, const Summary *call);
+    int *lookup(int symbol);
+    bool read(const VariableWrapper &vw, int &value);
+    void walk(Summary *summary, int steps, const std::vector<Pixel> *run = nullptr);
+    void include(Summary *summary, double x0, double y0, double x1, double y1);
+    void includePath(Summary *summary, double x, double y);
+    const Summary *summarizeTop(Function *function);
+    // move the turtle as the body would; with draw also rasterize what it draws
+    void replay(const Summary *summary, bool draw = false);
+    bool misses(const Summary *summary) const;
+
+public:
+    CallCuller(Executor *executor);
+    ~CallCuller();
+    // called with the frame of the call pushed and its arguments bound; true if
+    // the body was skipped, the caller then only pops the frame
+    bool cull(Function *function);
+    long getCulledCount() const { return culled; }
+};
+
+#endif // CALLCULLER_H
@@ -0,0 +1,310 @@
+#include "CostEstimator.h"
+#include "Executor.h"
+#include "Function.h"
+#include "Op.h"
+#include <algorithm>
+#include <iomanip>
+
+// Fitted by tools/calibrate_cost.py to the optimized, compiled renders of the
+// test cases and the benchmark programs, one thread
+static const double START_MS = 3.0;
+static const double NS_PER_PROGRAM_OP = 1500;   // scanning, parsing, checking and optimizing
+static const double NS_PER_OP = 4.1;            // most hot ops run compiled
+static const double NS_PER_CALL = 150;          // frames, culling, the stamp cache
+static const double NS_PER_OFF_CANVAS_OP = 8.8; // the culler runs a call once to summarize it
+static const double NS_PER_PIXEL = 0.9;         // footprint pixels that reach the canvas
+static const double NS_PER_CANVAS_BYTE = 2.1;   // clearing the buffer and encoding it
+
+double CostEstimate::predictedMs() const {
+    return START_MS + (programOps * NS_PER_PROGRAM_OP + (ops - offCanvasOps) * NS_PER_OP + (calls - offCanvasCalls) * NS_PER_CALL +
+                       offCanvasOps * NS_PER_OFF_CANVAS_OP + canvasPixels * NS_PER_PIXEL + canvasBytes * NS_PER_CANVAS_BYTE) / 1e6;
+}
+
+void CostEstimate::print(std::ostream &out) const {
+    std::ios::fmtflags flags = out.flags();
+    out << std::fixed << std::setprecision(0);
+    const char *bound = complete && bounded ? "" : "at least ";
+    if (!bounded)
+        out << "estimated ops: unbounded, a function calls itself" << std::endl;
+    else
+        out << "estimated ops: " << bound << ops << std::endl;
+    out << "program ops: " << programOps << std::endl;
+    out << "estimated calls: " << bound << calls << std::endl;
+    out << "ops in calls off the canvas: " << bound << offCanvasOps << std::endl;
+    out << "calls in calls off the canvas: " << bound << offCanvasCalls << std::endl;
+    out << "path length: " << bound << pathLength << std::endl;
+    out << "pen area: " << bound << penArea << std::endl;
+    out << "estimated pixel writes: " << bound << pixelWrites << std::endl;
+    out << "pixel writes on the canvas: " << bound << canvasPixels << std::endl;
+    out << "call depth: " << callDepth << (bounded ? "" : ", unbounded") << std::endl;
+    if (!canvasKnown)
+        out << "canvas: sized by the drawing (@SIZE AUTO)" << std::endl;
+    else
+        out << "canvas: " << canvasBytes << " bytes" << std::endl;
+    if (bounded)
+        out << std::setprecision(1) << "predicted time: " << bound << predictedMs() << " ms" << std::endl;
+    out.flags(flags);
+}
+
+CostEstimator::CostEstimator(Executor *executor) : executor(executor) {
+}
+
+CostEstimator::~CostEstimator() {
+}
+
+// same search order as Executor::getVariableBySymbol, nullptr if unbound
+int *CostEstimator::lookup(int symbol) {
+    for (size_t f = frameBases.size(); f-- > 0;) {
+        size_t end = f + 1 < frameBases.size() ? frameBases[f + 1] : bindings.size();
+        for (size_t i = frameBases[f]; i < end; i++) {
+            if (bindings[i].first == symbol)
+                return &bindings[i].second;
+        }
+    }
+    return nullptr;
+}
+
+// the Verifier has proven that every name read is bound
+int CostEstimator::read(const VariableWrapper &vw) {
+    if (vw.isLiteral())
+        return vw.getLiteral();
+    int *binding = lookup(vw.getSymbol());
+    return binding ? *binding : 0;
+}
+
+CostEstimator::State CostEstimator::save() const {
+    State state;
+    state.values.reserve(bindings.size());
+    for (size_t i = 0; i < bindings.size(); i++)
+        state.values.push_back(bindings[i].second);
+    state.penWidth = penWidth;
+    state.cloaked = cloaked;
+    state.degree = degree;
+    return state;
+}
+
+void CostEstimator::restore(const State &state) {
+    for (size_t i = 0; i < bindings.size(); i++)
+        bindings[i].second = state.values[i];
+    penWidth = state.penWidth;
+    cloaked = state.cloaked;
+    degree = state.degree;
+}
+
+// everything but the heading, which only moves the turtle
+bool CostEstimator::sameValues(const State &a, const State &b) {
+    return a.values == b.values && a.penWidth == b.penWidth && a.cloaked == b.cloaked;
+}
+
+void CostEstimator::Cost::add(const Cost &cost, double times) {
+    ops += times * cost.ops;
+    calls += times * cost.calls;
+    offCanvasOps += times * cost.offCanvasOps;
+    offCanvasCalls += times * cost.offCanvasCalls;
+    pathLength += times * cost.pathLength;
+    penArea += times * cost.penArea;
+    pixelWrites += times * cost.pixelWrites;
+    canvasPixels += times * cost.canvasPixels;
+}
+
+static double series(double first, double second, double n) {
+    return std::max(n * first + n * (n - 1) / 2 * (second - first), 0.0);
+}
+
+void CostEstimator::Cost::addSeries(const Cost &first, const Cost &second, double n) {
+    ops += series(first.ops, second.ops, n);
+    calls += series(first.calls, second.calls, n);
+    offCanvasOps += series(first.offCanvasOps, second.offCanvasOps, n);
+    offCanvasCalls += series(first.offCanvasCalls, second.offCanvasCalls, n);
+    pathLength += series(first.pathLength, second.pathLength, n);
+    penArea += series(first.penArea, second.penArea, n);
+    pixelWrites += series(first.pixelWrites, second.pixelWrites, n);
+    canvasPixels += series(first.canvasPixels, second.canvasPixels, n);
+}
+
+// a MOVE, walked as Executor::moveTurtle and drawLine walk it
+void CostEstimator::move(int steps, Cost &cost) {
+    double dx = Executor::degreeCos(degree);
+    double dy = Executor::degreeSin(degree);
+    if (cloaked) {
+        x += steps * dx;
+        y += steps * dy;
+        return;
+    }
+    // a drawing MOVE of steps <= 0 draws nothing and leaves the turtle
+    if (steps <= 0)
+        return;
+    int half = penWidth / 2;
+    double footprint = (2.0 * half + 1) * (2 * half + 1);
+    int first = 0;
+    int last = steps;
+    if (clip) {
+        Executor::clipSteps(x, dx, executor->originX - half - 2.0, executor->originX + executor->width + half + 1.0, first, last);
+        Executor::clipSteps(y, dy, executor->originY - half - 2.0, executor->originY + executor->height + half + 1.0, first, last);
+        if (last < first)
+            last = first;
+    }
+    cost.pathLength += steps;
+    cost.penArea += static_cast<double>(steps) * penWidth;
+    cost.pixelWrites += steps * footprint;
+    cost.canvasPixels += (last - first) * footprint;
+    x += steps * dx;
+    y += steps * dy;
+}
+
+// the body [begin, end) of a LOOP of loops > 0 iterations, END LOOP included
+bool CostEstimator::evalLoop(std::vector<Op *> &ops, size_t begin, size_t end, int loops, Cost &cost) {
+    // a loop that runs twice has no DEF of its own, the bindings keep their places
+    State before = save();
+    double x0 = x, y0 = y;
+    long start = budget;
+    Cost first;
+    bool ok = evalOps(ops, begin, end, first);
+    first.ops++;
+    if (!ok || loops == 1 || (loops - 1.0) * (start - budget) <= budget / 2) {
+        cost.add(first);
+        for (int k = 1; ok && k < loops; k++) {
+            Cost next;
+            ok = evalOps(ops, begin, end, next);
+            next.ops++;
+            cost.add(next);
+        }
+        return ok;
+    }
+    State after = save();
+    long long n = loops;
+    if (sameValues(before, after)) {
+        cost.add(first, loops);
+        if (after.degree == before.degree) {
+            // every iteration moves the turtle by the same amount
+            x = x0 + n * (x - x0);
+            y = y0 + n * (y - y0);
+        } else {
+            degree = static_cast<int>(((before.degree + n * (after.degree - before.degree)) % 360 + 360) % 360);
+            clip = false;
+        }
+        return true;
+    }
+    Cost second;
+    ok = evalOps(ops, begin, end, second);
+    second.ops++;
+    cost.addSeries(first, second, loops);
+    if (!ok)
+        return false;
+    // every iteration changes the values as the first one did
+    State last = save();
+    for (size_t k = 0; k < last.values.size(); k++)
+        last.values[k] = static_cast<int>(before.values[k] + n * (static_cast<long long>(after.values[k]) - before.values[k]));
+    last.degree = static_cast<int>(((before.degree + n * (after.degree - before.degree)) % 360 + 360) % 360);
+    restore(last);
+    clip = false;
+    return true;
+}
+
+// false once the walk cannot go on, cost then holds what was walked so far
+bool CostEstimator::evalOps(std::vector<Op *> &ops, size_t begin, size_t end, Cost &cost) {
+    for (size_t i = begin; i < end; i++) {
+        if (--budget < 0) {
+            estimate.complete = false;
+            return false;
+        }
+        Op *op = ops[i];
+        cost.ops++;
+        if (StartLoopOp *loop = dynamic_cast<StartLoopOp *>(op)) {
+            size_t close = i + 1;
+            while (ops[close] != loop->end)
+                close++;
+            if (loop->prop_loops > 0 && !evalLoop(ops, i + 1, close, loop->prop_loops, cost))
+                return false;
+            i = close;
+        } else if (MoveOp *move = dynamic_cast<MoveOp *>(op)) {
+            this->move(read(move->_varWrapper), cost);
+        } else if (TurnOp *turn = dynamic_cast<TurnOp *>(op)) {
+            // as Executor::turnTurtle
+            degree -= read(turn->varWrapper);
+            degree = (degree + 360) % 360;
+        } else if (dynamic_cast<ColorOp *>(op)) {
+            cloaked = false;
+        } else if (dynamic_cast<CloakOp *>(op)) {
+            cloaked = true;
+        } else if (SetPenWidthOp *width = dynamic_cast<SetPenWidthOp *>(op)) {
+            int w = read(width->varWrapper);
+            if (w > 0)
+                penWidth = w;
+        } else if (AddOp *add = dynamic_cast<AddOp *>(op)) {
+            if (int *binding = lookup(add->var.getSymbol()))
+                *binding = static_cast<int>(static_cast<unsigned>(*binding) + static_cast<unsigned>(read(add->value)));
+        } else if (DefOp *def = dynamic_cast<DefOp *>(op)) {
+            int value = read(def->varWrapper);
+            bindings.push_back(std::make_pair(def->symbol, value));
+        } else if (CallOp *call = dynamic_cast<CallOp *>(op)) {
+            if (!evalCall(call->target, call->argList, cost))
+                return false;
+        }
+    }
+    return true;
+}
+
+bool CostEstimator::evalCall(Function *function, const std::vector<VariableWrapper> &args, Cost &cost) {
+    // without a condition to stop it, a recursion never returns
+    if (std::find(active.begin(), active.end(), function) != active.end()) {
+        estimate.bounded = false;
+        return false;
+    }
+    active.push_back(function);
+    cost.calls++;
+    estimate.callDepth = std::max(estimate.callDepth, static_cast<int>(active.size()));
+    // the frame is pushed before the arguments are read, as in CallOp
+    frameBases.push_back(bindings.size());
+    std::vector<VariableWrapper> &paraList = function->getParaList();
+    for (size_t k = 0; k < args.size(); k++) {
+        int value = read(args[k]);
+        bindings.push_back(std::make_pair(paraList[k].getSymbol(), value));
+    }
+    std::vector<Op *> &ops = *function->getOps();
+    Cost body;
+    bool ok = evalOps(ops, 0, ops.size(), body);
+    // CallCuller skips the body of a call that draws nothing on the canvas
+    if (ok && clip && body.canvasPixels == 0) {
+        body.offCanvasOps = body.ops;
+        body.offCanvasCalls = body.calls;
+    }
+    cost.add(body);
+    bindings.resize(frameBases.back());
+    frameBases.pop_back();
+    active.pop_back();
+    return ok;
+}
+
+CostEstimate CostEstimator::run(bool autoSize, bool svg) {
+    estimate = CostEstimate();
+    bindings.clear();
+    frameBases.assign(1, 0);
+    active.clear();
+    penWidth = 1;
+    cloaked = false;
+    degree = 90;
+    x = executor->start_pen_x;
+    y = executor->start_pen_y;
+    // the canvas of @SIZE AUTO covers every step
+    clip = !autoSize && !svg;
+    budget = EVAL_BUDGET;
+
+    Cost cost;
+    std::vector<Op *> &ops = *executor->allFunctions[0]->getOps();
+    evalOps(ops, 0, ops.size(), cost);
+    for (size_t i = 0; i < executor->allFunctions.size(); i++)
+        estimate.programOps += executor->allFunctions[i]->getOps()->size();
+    estimate.ops = cost.ops;
+    estimate.calls = cost.calls;
+    estimate.offCanvasOps = cost.offCanvasOps;
+    estimate.offCanvasCalls = cost.offCanvasCalls;
+    estimate.pathLength = cost.pathLength;
+    estimate.penArea = cost.penArea;
+    estimate.pixelWrites = cost.pixelWrites;
+    estimate.canvasPixels = cost.canvasPixels;
+    estimate.canvasKnown = !autoSize;
+    if (!autoSize && !svg)
+        estimate.canvasBytes = static_cast<size_t>(executor->width) * executor->height * sizeof(Pixel);
+    return estimate;
+}
@@ -0,0 +1,96 @@
+#if !defined(COSTESTIMATOR_H)
+#define COSTESTIMATOR_H
+
+#include <cstddef>
+#include <ostream>
+#include <utility>
+#include <vector>
+
+class Executor;
+class Function;
+class Op;
+class VariableWrapper;
+
+// What a run of the program will cost, predicted from the ops alone
+struct CostEstimate {
+    bool bounded = true;       // false for a recursion, which never terminates
+    bool complete = true;      // false when the evaluation budget ran out, the counts are a lower bound
+    size_t programOps = 0;     // ops in the program text, parsing them costs time too
+    double ops = 0;            // ops executed as written, before optimization
+    double calls = 0;          // CALLs executed
+    double offCanvasOps = 0;   // of the ops, those in calls that draw nothing on the canvas,
+    double offCanvasCalls = 0; // which the culling skips (and the CALLs among them)
+    double pathLength = 0;     // steps of the drawing MOVEs
+    double penArea = 0;        // steps times pen width
+    double pixelWrites = 0;    // pixels of every pen footprint, as --dry-run counts them
+    double canvasPixels = 0;   // the pixel writes of the steps whose footprint reaches the canvas
+    int callDepth = 0;         // deepest nesting of calls
+    bool canvasKnown = true;   // false with @SIZE AUTO, the drawing decides the size
+    size_t canvasBytes = 0;    // the pixel buffer, 0 for SVG output
+
+    // the time a render takes on the reference machine, from the counts
+    double predictedMs() const;
+    void print(std::ostream &out) const;
+};
+
+// Walks the parsed program without drawing anything. Control flow only
+// depends on literal loop counts, and every value is computed from literals,
+// so the walk follows the run exactly, turtle included, while the evaluation
+// budget lasts. A loop that would take too much of it is walked twice: if the
+// first iteration leaves the values as it found them every iteration costs
+// the same, else the second iteration shows how they change (an ADD of a
+// constant makes the MOVE lengths an arithmetic series), and the loop is
+// summed as if every further iteration changed them the same way. Where the
+// turtle is after such a loop is not followed, every later step counts as
+// reaching the canvas.
+class CostEstimator {
+public:
+    // ops evaluated for one estimate
+    static const long EVAL_BUDGET = 1 << 22;
+
+private:
+    struct Cost {
+        double ops = 0, calls = 0, offCanvasOps = 0, offCanvasCalls = 0;
+        double pathLength = 0, penArea = 0, pixelWrites = 0, canvasPixels = 0;
+        void add(const Cost &cost, double times = 1);
+        // n iterations costing first, second, ... as an arithmetic series
+        void addSeries(const Cost &first, const Cost &second, double n);
+    };
+    // what decides the cost of the ops that follow, except for the turtle position
+    struct State {
+        std::vector<int> values; // of every binding
+        int penWidth;
+        bool cloaked;
+        int degree;
+    };
+    Executor *executor;
+    // bindings of the frames of the walk, the top frame last, as in CallCuller
+    std::vector<std::pair<int, int>> bindings;
+    std::vector<size_t> frameBases;
+    std::vector<Function *> active; // the functions being called, to find a recursion
+    int penWidth = 1;
+    bool cloaked = false;
+    int degree = 90;
+    double x = 0, y = 0;
+    bool clip = true; // the turtle position is known and the canvas is fixed
+    long budget = EVAL_BUDGET;
+    CostEstimate estimate;
+
+    int *lookup(int symbol);
+    int read(const VariableWrapper &vw);
+    State save() const;
+    void restore(const State &state);
+    static bool sameValues(const State &a, const State &b);
+    void move(int steps, Cost &cost);
+    bool evalLoop(std::vector<Op *> &ops, size_t begin, size_t end, int loops, Cost &cost);
+    bool evalOps(std::vector<Op *> &ops, size_t begin, size_t end, Cost &cost);
+    bool evalCall(Function *function, const std::vector<VariableWrapper> &args, Cost &cost);
+
+public:
+    CostEstimator(Executor *executor);
+    ~CostEstimator();
+    // after the Verifier has proven the program and before the Optimizer changes its ops
+    CostEstimate run(bool autoSize, bool svg);
+};
+
+#endif // COSTESTIMATOR_H
@@ -0,0 +1,586 @@
+#include "CppEmitter.h"
+#include "Executor.h"
+#include "Function.h"
+#include "Op.h"
+#include <fstream>
+
+// The rasterizer of the generated program, the same arithmetic as Executor
+// (moveTurtle, drawLine, drawPixelRun) and FileWriter, so the output is byte
+// identical. It follows the canvas constants emitted in front of it; the
+// helpers a program may not call are inline, so none of them is reported unused.
+static const char *runtime = R"RUNTIME(
+struct Pixel {
+    unsigned char r, g, b, alpha;
+};
+
+std::vector<Pixel> buffer;
+double pen_x = START_X;
+double pen_y = START_Y;
+int degree = 90;
+bool cloaked = false;
+Pixel penColor = {0, 0, 0, 1};
+int penWidth = 1;
+double cosTable[360];
+double sinTable[360];
+int argCount;
+char **args;
+
+void runtimeError(const std::string &err, int lineno = -1) {
+    if (lineno == -1)
+        std::cerr << "Runtime Error: " << err << std::endl;
+    else
+        std::cerr << "Runtime Error at line " << lineno << ": " << err << std::endl;
+    exit(1);
+}
+
+void error(const char *text) {
+    std::printf("Error at line %d: %s\n", ERROR_LINE, text);
+    exit(1);
+}
+
+// a variable bound by a caller, null when no frame defines it
+inline int rd(const int *p, const char *name) {
+    if (!p)
+        runtimeError(std::string("cannot find variable ") + name);
+    return *p;
+}
+
+inline int missing(const char *name) {
+    runtimeError(std::string("cannot find variable ") + name);
+    return 0;
+}
+
+// NAME=VALUE on the command line overrides a global DEF
+inline int param(const char *name, int value) {
+    size_t n = strlen(name);
+    for (int i = 1; i < argCount; i++) {
+        if (!strncmp(args[i], name, n) && args[i][n] == '=')
+            value = atoi(args[i] + n + 1);
+    }
+    return value;
+}
+
+inline double headingCos() {
+    if (0 <= degree && degree < 360)
+        return cosTable[degree];
+    return cos(degree * PI / 180.0);
+}
+
+inline double headingSin() {
+    if (0 <= degree && degree < 360)
+        return sinTable[degree];
+    return sin(degree * PI / 180.0);
+}
+
+inline void fillSpan(int y, int x0, int x1) {
+    y -= ORIGIN_Y;
+    x0 -= ORIGIN_X;
+    x1 -= ORIGIN_X;
+    if (y < 0 || y >= HEIGHT)
+        return;
+    if (x0 < 0)
+        x0 = 0;
+    if (x1 >= WIDTH)
+        x1 = WIDTH - 1;
+    Pixel *p = buffer.data() + (size_t)y * WIDTH;
+    for (int x = x0; x <= x1; x++)
+        p[x] = penColor;
+}
+
+void clipSteps(double pos, double d, double lo, double hi, int &first, int &last) {
+    if (std::fabs(d) < 1e-9) {
+        if (pos < lo || pos > hi)
+            last = first;
+        return;
+    }
+    double t0 = (lo - pos) / d;
+    double t1 = (hi - pos) / d;
+    if (t0 > t1)
+        std::swap(t0, t1);
+    if (t0 - 1 > first)
+        first = t0 - 1 > last ? last : static_cast<int>(t0 - 1);
+    if (t1 + 2 < last)
+        last = t1 + 2 < first ? first : static_cast<int>(t1 + 2);
+}
+
+void drawLine(int steps) {
+    double dx = headingCos();
+    double dy = headingSin();
+    int half = penWidth / 2;
+    int first = 0;
+    int last = steps;
+    clipSteps(pen_x, dx, ORIGIN_X - half - 2.0, ORIGIN_X + WIDTH + half + 1.0, first, last);
+    clipSteps(pen_y, dy, ORIGIN_Y - half - 2.0, ORIGIN_Y + HEIGHT + half + 1.0, first, last);
+    if (last < first)
+        last = first;
+    int i = 0;
+    for (; i < first; i++) {
+        pen_x += dx;
+        pen_y += dy;
+    }
+    for (; i < last; i++) {
+        int x = static_cast<int>(pen_x + 0.5);
+        int y = static_cast<int>(pen_y + 0.5);
+        for (int yy = y - half; yy < y + half + 1; yy++)
+            fillSpan(yy, x - half, x + half);
+        pen_x += dx;
+        pen_y += dy;
+    }
+    for (; i < steps; i++) {
+        pen_x += dx;
+        pen_y += dy;
+    }
+}
+
+inline void move(int steps) {
+    if (cloaked) {
+        pen_x += steps * headingCos();
+        pen_y += steps * headingSin();
+    } else {
+        drawLine(steps);
+    }
+}
+
+inline void turn(int degrees) {
+    degree -= degrees;
+    degree = (degree + 360) % 360;
+}
+
+inline void color(int r, int g, int b) {
+    if (r > 255 || g > 255 || b > 255 || r < 0 || g < 0 || b < 0) {
+        std::cout << "Runtime warning: Color value out of range, value larger than 255 will be set to 255, value smaller than 0 will be set 0" << std::endl;
+    }
+    r = std::max(std::min(r, 255), 0);
+    g = std::max(std::min(g, 255), 0);
+    b = std::max(std::min(b, 255), 0);
+    penColor.r = r;
+    penColor.g = g;
+    penColor.b = b;
+    penColor.alpha = 1;
+    cloaked = false;
+}
+
+inline void setPenWidth(int w) {
+    if (w > 0)
+        penWidth = w;
+    else
+        error("Pen width should be larger than 1");
+}
+
+inline void cloak() {
+    cloaked = true;
+}
+
+inline void fill() {
+    std::cout << "FILL" << std::endl;
+}
+
+inline void pixelRun(const Pixel *colors, size_t count) {
+    cloaked = false;
+    if (penWidth / 2 != 0) {
+        for (size_t i = 0; i < count; i++) {
+            penColor = colors[i];
+            drawLine(1);
+        }
+        return;
+    }
+    double dx = headingCos();
+    double dy = headingSin();
+    for (size_t i = 0; i < count; i++) {
+        int x = static_cast<int>(pen_x + 0.5) - ORIGIN_X;
+        int y = static_cast<int>(pen_y + 0.5) - ORIGIN_Y;
+        if (0 <= x && x < WIDTH && 0 <= y && y < HEIGHT)
+            buffer[(size_t)y * WIDTH + x] = colors[i];
+        pen_x += dx;
+        pen_y += dy;
+    }
+    penColor = colors[count - 1];
+}
+
+bool writeBMP(const std::string &filename) {
+    FILE *fp = fopen(filename.c_str(), "wb");
+    if (!fp)
+        return false;
+    int size = WIDTH * HEIGHT * 4;
+    unsigned char fileHeader[14] = {'B', 'M', 0, 0, 0, 0, 0, 0, 0, 0, 54, 0, 0, 0};
+    unsigned char infoHeader[40] = {40, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 24, 0};
+    for (int i = 0; i < 4; i++) {
+        fileHeader[2 + i] = (unsigned char)(size >> (8 * i));
+        infoHeader[4 + i] = (unsigned char)(WIDTH >> (8 * i));
+        infoHeader[8 + i] = (unsigned char)(HEIGHT >> (8 * i));
+    }
+    fwrite(fileHeader, 1, 14, fp);
+    fwrite(infoHeader, 1, 40, fp);
+    unsigned char pad[3] = {0, 0, 0};
+    std::vector<unsigned char> row(3 * WIDTH);
+    for (int y = 0; y < HEIGHT; y++) {
+        const Pixel *p = buffer.data() + (size_t)y * WIDTH;
+        for (int x = 0; x < WIDTH; x++) {
+            row[x * 3 + 2] = p[x].r;
+            row[x * 3 + 1] = p[x].g;
+            row[x * 3 + 0] = p[x].b;
+        }
+        fwrite(row.data(), 3, WIDTH, fp);
+        fwrite(pad, 1, (4 - (WIDTH * 3) % 4) % 4, fp);
+    }
+    fclose(fp);
+    return true;
+}
+)RUNTIME";
+
+CppEmitter::CppEmitter(Executor *executor) : executor(executor) {
+}
+
+CppEmitter::~CppEmitter() {
+}
+
+std::string CppEmitter::localName(int symbol) {
+    return "v_" + Variable::symbolName(symbol);
+}
+
+std::string CppEmitter::pointerName(int symbol) {
+    return "p_" + Variable::symbolName(symbol);
+}
+
+std::string CppEmitter::line() {
+    return std::string(indent * 4, ' ');
+}
+
+// the last definition of a name wins, as in CallOp
+CppEmitter::Unit *CppEmitter::findUnit(const std::string &name) {
+    Unit *result = nullptr;
+    for (size_t i = 0; i < units.size(); i++) {
+        if (units[i].function->getName() == name)
+            result = &units[i];
+    }
+    return result;
+}
+
+CppEmitter::Unit *CppEmitter::findUnit(Function *function) {
+    for (size_t i = 0; i < units.size(); i++) {
+        if (units[i].function == function)
+            return &units[i];
+    }
+    return nullptr;
+}
+
+// the frame of the function first, then whatever the caller passes in
+CppEmitter::Binding CppEmitter::resolve(int symbol) {
+    Binding binding;
+    for (size_t i = 0; i < frame.size(); i++) {
+        if (frame[i].first == symbol) {
+            binding.kind = Binding::LOCAL;
+            binding.expr = frame[i].second;
+            return binding;
+        }
+    }
+    if (unit == &units[0]) {
+        // nothing is below the global frame
+        binding.kind = Binding::MISSING;
+        return binding;
+    }
+    if (unit->freeSymbols.insert(symbol).second)
+        changed = true;
+    binding.kind = Binding::FREE;
+    binding.expr = pointerName(symbol);
+    return binding;
+}
+
+std::string CppEmitter::read(const Binding &binding, int symbol) {
+    switch (binding.kind) {
+    case Binding::LOCAL:
+        return binding.expr;
+    case Binding::FREE:
+        return "rd(" + binding.expr + ", \"" + Variable::symbolName(symbol) + "\")";
+    default:
+        return "missing(\"" + Variable::symbolName(symbol) + "\")";
+    }
+}
+
+std::string CppEmitter::read(const VariableWrapper &vw) {
+    if (vw.isLiteral())
+        return std::to_string(vw.getLiteral());
+    return read(resolve(vw.getSymbol()), vw.getSymbol());
+}
+
+// A DEF binds the name from here on. Inside a loop that runs more than once
+// the interpreter fails on the second pass, a flag reproduces that.
+void CppEmitter::emitDef(int symbol, const VariableWrapper &value, bool repeated) {
+    const std::string &name = Variable::symbolName(symbol);
+    for (size_t i = 0; i < frame.size(); i++) {
+        if (frame[i].first == symbol) {
+            body << line() << "runtimeError(\"Variable " << name << " is already defined\");\n";
+            return;
+        }
+    }
+    if (repeated) {
+        guards.insert(symbol);
+        body << line() << "if (d_" << name << ")\n";
+        body << line() << "    runtimeError(\"Variable " << name << " is already defined\");\n";
+        body << line() << "d_" << name << " = true;\n";
+    }
+    // the value is read before the name is bound
+    std::string expr = read(value);
+    if (unit == &units[0] && !repeated && indent == 1 && value.isLiteral())
+        expr = "param(\"" + name + "\", " + expr + ")";
+    body << line() << localName(symbol) << " = " << expr << ";\n";
+    locals.insert(symbol);
+    frame.push_back(std::make_pair(symbol, localName(symbol)));
+}
+
+// Arguments are evaluated with the parameters bound so far already visible,
+// as CallOp pushes the frame first.
+void CppEmitter::emitCall(Unit *callee, const std::vector<VariableWrapper> &argList, int lineno) {
+    std::vector<VariableWrapper> &paraList = callee->function->getParaList();
+    if (paraList.size() != argList.size()) {
+        body << line() << "runtimeError(\"arguments do not match\", " << lineno << ");\n";
+        return;
+    }
+    std::vector<std::pair<int, std::string>> calleeFrame;
+    std::string call = callee->cname + "(";
+    if (!argList.empty()) {
+        body << line() << "{\n";
+        indent++;
+    }
+    for (size_t i = 0; i < argList.size(); i++) {
+        std::string value;
+        if (argList[i].isVariable()) {
+            for (size_t j = 0; j < calleeFrame.size() && value.empty(); j++) {
+                if (calleeFrame[j].first == argList[i].getSymbol())
+                    value = calleeFrame[j].second;
+            }
+        }
+        if (value.empty())
+            value = read(argList[i]);
+        std::string arg = "a" + std::to_string(i);
+        body << line() << "int " << arg << " = " << value << ";\n";
+        calleeFrame.push_back(std::make_pair(paraList[i].getSymbol(), arg));
+        call += (i ? ", " : "") + arg;
+    }
+    bool first = argList.empty();
+    for (auto it = callee->freeSymbols.begin(); it != callee->freeSymbols.end(); it++) {
+        Binding binding = resolve(*it);
+        std::string pointer = binding.kind == Binding::LOCAL ? "&" + binding.expr : binding.kind == Binding::FREE ? binding.expr : "nullptr";
+        call += (first ? "" : ", ") + pointer;
+        first = false;
+    }
+    body << line() << call << ");\n";
+    if (!argList.empty()) {
+        indent--;
+        body << line() << "}\n";
+    }
+}
+
+void CppEmitter::walk(Unit &u) {
+    unit = &u;
+    frame.clear();
+    locals.clear();
+    guards.clear();
+    body.str("");
+    indent = 1;
+
+    std::vector<VariableWrapper> &paraList = u.function->getParaList();
+    for (size_t i = 0; i < paraList.size(); i++) {
+        int symbol = paraList[i].getSymbol();
+        if (locals.count(symbol))
+            continue; // a repeated parameter name, the first one is found
+        locals.insert(symbol);
+        frame.push_back(std::make_pair(symbol, localName(symbol)));
+        body << line() << localName(symbol) << " = arg" << i << ";\n";
+    }
+
+    std::vector<Op *> &ops = *u.function->getOps();
+    std::vector<int> outerPasses; // passes of the enclosing loop, per nesting level
+    int passes = 1;               // how often the current op runs per call, capped at 2
+    for (size_t i = 0; i < ops.size(); i++) {
+        Op *op = ops[i];
+        if (StartLoopOp *loop = dynamic_cast<StartLoopOp *>(op)) {
+            if (!loop->end) {
+                // nothing after this point runs
+                body << line() << "runtimeError(\"END LOOP not found\", " << loop->getLineNo() << ");\n";
+                while (!outerPasses.empty()) {
+                    indent--;
+                    body << line() << "}\n";
+                    outerPasses.pop_back();
+                }
+                break;
+            }
+            if (loop->prop_loops <= 0) {
+                if (loop->prop_loops < 0)
+                    body << line() << "error(\"loop value should be non-negative\");\n";
+                // the body never runs, continue after the matching END LOOP
+                int depth = 0;
+                for (; i < ops.size(); i++) {
+                    if (ops[i]->isStartLoopOp())
+                        depth++;
+                    else if (ops[i]->isEndLoopOp() && --depth == 0)
+                        break;
+                }
+                continue;
+            }
+            std::string counter = "i" + std::to_string(outerPasses.size());
+            body << line() << "for (int " << counter << " = 0; " << counter << " < " << loop->prop_loops << "; " << counter << "++) {\n";
+            indent++;
+            outerPasses.push_back(passes);
+            passes = loop->prop_loops > 1 ? 2 : passes;
+        } else if (op->isEndLoopOp()) {
+            indent--;
+            body << line() << "}\n";
+            passes = outerPasses.back();
+            outerPasses.pop_back();
+        } else if (MoveOp *move = dynamic_cast<MoveOp *>(op)) {
+            body << line() << "move(" << read(move->_varWrapper) << ");\n";
+        } else if (TurnOp *turn = dynamic_cast<TurnOp *>(op)) {
+            body << line() << "turn(" << read(turn->varWrapper) << ");\n";
+        } else if (SetPenWidthOp *width = dynamic_cast<SetPenWidthOp *>(op)) {
+            body << line() << "setPenWidth(" << read(width->varWrapper) << ");\n";
+        } else if (op->isCloakOp()) {
+            body << line() << "cloak();\n";
+        } else if (dynamic_cast<FillOp *>(op)) {
+            body << line() << "fill();\n";
+        } else if (ColorOp *color = dynamic_cast<ColorOp *>(op)) {
+            if (color->r.isLiteral() && color->g.isLiteral() && color->b.isLiteral()) {
+                body << line() << "color(" << read(color->r) << ", " << read(color->g) << ", " << read(color->b) << ");\n";
+            } else {
+                // evaluated in order, each read may fail
+                body << line() << "{\n";
+                body << line() << "    int r = " << read(color->r) << ";\n";
+                body << line() << "    int g = " << read(color->g) << ";\n";
+                body << line() << "    int b = " << read(color->b) << ";\n";
+                body << line() << "    color(r, g, b);\n";
+                body << line() << "}\n";
+            }
+        } else if (AddOp *add = dynamic_cast<AddOp *>(op)) {
+            // adding to an undefined variable does nothing, the value is not even read
+            Binding binding = resolve(add->var.getSymbol());
+            if (binding.kind == Binding::LOCAL)
+                body << line() << binding.expr << " += " << read(add->value) << ";\n";
+            else if (binding.kind == Binding::FREE)
+                body << line() << "if (" << binding.expr << ")\n"
+                     << line() << "    *" << binding.expr << " += " << read(add->value) << ";\n";
+        } else if (DefOp *def = dynamic_cast<DefOp *>(op)) {
+            emitDef(def->symbol, def->varWrapper, passes > 1);
+        } else if (CallOp *call = dynamic_cast<CallOp *>(op)) {
+            Unit *callee = findUnit(call->name);
+            if (callee)
+                emitCall(callee, call->argList, call->getLineNo());
+            else
+                body << line() << "runtimeError(\"function " << call->name << " not found\");\n";
+        } else if (InlineCallOp *inlined = dynamic_cast<InlineCallOp *>(op)) {
+            // call the original function instead, the C++ compiler does its own inlining
+            emitCall(findUnit(inlined->function), inlined->argList, inlined->getLineNo());
+            int depth = 0;
+            for (; i < ops.size(); i++) {
+                if (dynamic_cast<InlineCallOp *>(ops[i]))
+                    depth++;
+                else if (dynamic_cast<InlineReturnOp *>(ops[i]) && --depth == 0)
+                    break;
+            }
+        } else if (PixelRunOp *run = dynamic_cast<PixelRunOp *>(op)) {
+            if (!emitting)
+                continue;
+            std::string table = "run" + std::to_string(tableCount++);
+            const std::vector<Pixel> &colors = run->getColors();
+            tables << "const Pixel " << table << "[" << colors.size() << "] = {";
+            for (size_t k = 0; k < colors.size(); k++) {
+                tables << (k % 8 ? " " : "\n    ") << "{" << (int)colors[k].r << ", " << (int)colors[k].g << ", " << (int)colors[k].b << ", 1},";
+            }
+            tables << "\n};\n";
+            body << line() << "pixelRun(" << table << ", " << colors.size() << ");\n";
+        }
+    }
+}
+
+bool CppEmitter::write(const std::string &filename, const std::string &outFileName) {
+    units.clear();
+    for (size_t i = 0; i < executor->allFunctions.size(); i++) {
+        Unit u;
+        u.function = executor->allFunctions[i];
+        u.cname = "f" + std::to_string(i) + "_" + u.function->getName();
+        units.push_back(u);
+    }
+    // free sets only grow: walk every function until none changes
+    emitting = false;
+    do {
+        changed = false;
+        for (size_t i = 0; i < units.size(); i++)
+            walk(units[i]);
+    } while (changed);
+
+    std::vector<std::string> signatures;
+    std::vector<std::string> definitions;
+    emitting = true;
+    for (size_t i = 0; i < units.size(); i++) {
+        Unit &u = units[i];
+        walk(u);
+        std::string signature = "void " + u.cname + "(";
+        bool first = true;
+        for (size_t k = 0; k < u.function->getParaList().size(); k++) {
+            signature += (first ? "" : ", ") + std::string("int arg") + std::to_string(k);
+            first = false;
+        }
+        for (auto it = u.freeSymbols.begin(); it != u.freeSymbols.end(); it++) {
+            signature += (first ? "" : ", ") + std::string("int *") + pointerName(*it);
+            first = false;
+        }
+        signature += ")";
+        std::ostringstream definition;
+        definition << signature << " {\n";
+        for (auto it = locals.begin(); it != locals.end(); it++)
+            definition << "    int " << localName(*it) << " = 0;\n";
+        for (auto it = guards.begin(); it != guards.end(); it++)
+            definition << "    bool d_" << Variable::symbolName(*it) << " = false;\n";
+        definition << body.str() << "}\n";
+        signatures.push_back(signature);
+        definitions.push_back(definition.str());
+    }
+
+    std::ofstream out(filename);
+    if (!out)
+        return false;
+    Pixel background = executor->background;
+    out << "// Generated by LogoCompiler --emit-cpp, renders " << outFileName << "\n"
+        << "// build: g++ -O2 -ffp-contract=off -o renderer " << filename << "\n"
+        << "// usage: renderer [output.bmp] [NAME=VALUE ...], NAME=VALUE overrides a global DEF\n"
+        << "#include <algorithm>\n#include <cmath>\n#include <cstdio>\n#include <cstdlib>\n#include <cstring>\n"
+        << "#include <iostream>\n#include <string>\n#include <vector>\n\n"
+        << "namespace {\n\n"
+        << "const double PI = 3.14159265359;\n"
+        << "const int WIDTH = " << executor->width << ";\n"
+        << "const int HEIGHT = " << executor->height << ";\n"
+        << "const int ORIGIN_X = " << executor->originX << ";\n"
+        << "const int ORIGIN_Y = " << executor->originY << ";\n"
+        << "const double START_X = " << executor->start_pen_x << ";\n"
+        << "const double START_Y = " << executor->start_pen_y << ";\n"
+        << "const int ERROR_LINE = " << executor->lastLine << ";\n"
+        << runtime << "\n"
+        << tables.str() << "\n";
+    for (size_t i = 0; i < signatures.size(); i++)
+        out << signatures[i] << ";\n";
+    for (size_t i = 0; i < definitions.size(); i++)
+        out << "\n" << definitions[i];
+    out << "\n} // namespace\n\n"
+        << "int main(int argc, char **argv) {\n"
+        << "    argCount = argc;\n"
+        << "    args = argv;\n"
+        << "    std::string outFileName = \"" << outFileName << "\";\n"
+        << "    for (int i = 1; i < argc; i++) {\n"
+        << "        if (!strchr(argv[i], '='))\n"
+        << "            outFileName = argv[i];\n"
+        << "    }\n"
+        << "    for (int d = 0; d < 360; d++) {\n"
+        << "        cosTable[d] = cos(d * PI / 180.0);\n"
+        << "        sinTable[d] = sin(d * PI / 180.0);\n"
+        << "    }\n"
+        << "    Pixel background = {" << (int)background.r << ", " << (int)background.g << ", " << (int)background.b << ", 1};\n"
+        << "    buffer.assign((size_t)WIDTH * HEIGHT, background);\n"
+        << "    " << units[0].cname << "();\n"
+        << "    if (writeBMP(outFileName)) {\n"
+        << "        std::cout << \"write to file \" << outFileName << std::endl;\n"
+        << "    } else {\n"
+        << "        std::cerr << \"cannot write to file \" << outFileName << std::endl;\n"
+        << "    }\n"
+        << "    return 0;\n"
+        << "}\n";
+    return out.good();
+}
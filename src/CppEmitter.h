@@ -0,0 +1,68 @@
+#if !defined(CPPEMITTER_H)
+#define CPPEMITTER_H
+
+#include <set>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+class Executor;
+class Function;
+class Op;
+class VariableWrapper;
+
+// Translates the parsed program into one self-contained C++ translation unit
+// that renders the same BMP: every Function becomes a C++ function, LOOPs
+// become for loops and variables become C++ locals, with a small copy of the
+// rasterizer linked in. LOGO variables are dynamically scoped, so a function
+// takes a pointer for every name it reads without binding it itself; the
+// caller resolves those at the call site, exactly where the interpreter's
+// frame walk would have found them.
+class CppEmitter {
+private:
+    // where a name is found at one point of a function
+    struct Binding {
+        enum Kind { LOCAL, FREE, MISSING } kind;
+        std::string expr; // LOCAL: an int lvalue, FREE: an int * that is null when unbound
+    };
+    struct Unit {
+        Function *function;
+        std::string cname;
+        std::set<int> freeSymbols; // names used before the function binds them
+    };
+    Executor *executor;
+    std::vector<Unit> units;
+    bool changed = false; // a free set grew during the last analysis pass
+
+    // state of the function being walked
+    Unit *unit = nullptr;
+    bool emitting = false;
+    std::vector<std::pair<int, std::string>> frame; // names bound so far, in frame order
+    std::set<int> locals;                            // symbols with a C++ local
+    std::set<int> guards;                            // DEFs that run more than once
+    std::ostringstream body;
+    std::ostringstream tables; // PixelRunOp colors
+    int tableCount = 0;
+    int indent = 1;
+
+    Unit *findUnit(const std::string &name);
+    Unit *findUnit(Function *function);
+    Binding resolve(int symbol);
+    std::string read(const Binding &binding, int symbol);
+    std::string read(const VariableWrapper &vw);
+    std::string line();
+    void walk(Unit &u);
+    void emitCall(Unit *callee, const std::vector<VariableWrapper> &argList, int lineno);
+    void emitDef(int symbol, const VariableWrapper &value, bool repeated);
+    static std::string localName(int symbol);
+    static std::string pointerName(int symbol);
+
+public:
+    CppEmitter(Executor *executor);
+    ~CppEmitter();
+    // outFileName is the BMP the generated program writes when run without arguments
+    bool write(const std::string &filename, const std::string &outFileName);
+};
+
+#endif // CPPEMITTER_H
@@ -1,62 +1,202 @@
 #include "Executor.h"
+#include "BandRenderer.h"
+#include "BufferPool.h"
+#include "CallCuller.h"
 #include "FileWriter.h"
+#include "FrameRecorder.h"
 #include "Function.h"
+#include "Jit.h"
+#include "StampCache.h"
+#include "SvgWriter.h"
+#include "utility.h"
+#include <algorithm>
+#include <climits>
 #include <iostream>
-Executor *Executor::globalExe = nullptr;
+
+// cos and sin of every whole degree, exactly the values cos(degree * PI / 180.0) gives
+struct TrigTable {
+    double c[360];
+    double s[360];
+    TrigTable() {
+        for (int d = 0; d < 360; d++) {
+            c[d] = cos(d * PI / 180.0);
+            s[d] = sin(d * PI / 180.0);
+        }
+    }
+};
+static const TrigTable trigTable;
+
+// initial capacity of the call stack and of the variable stack
+static const size_t FRAME_POOL = 256;
+static const size_t VARIABLE_POOL = 1024;
+
+// ops, or pixels of compiled loops, between two looks at the clock with a time limit
+static const long CLOCK_CHECK_OPS = 1024;
+static const unsigned long long CLOCK_CHECK_PIXELS = 1 << 20;
+
+double Executor::degreeCos(int degree) {
+    if (0 <= degree && degree < 360)
+        return trigTable.c[degree];
+    return cos(degree * PI / 180.0);
+}
+
+double Executor::degreeSin(int degree) {
+    if (0 <= degree && degree < 360)
+        return trigTable.s[degree];
+    return sin(degree * PI / 180.0);
+}
+
+double Executor::headingCos() const {
+    return degreeCos(degree);
+}
+
+double Executor::headingSin() const {
+    return degreeSin(degree);
+}
 Executor::Executor() {
     penColor = Pixel(0, 0, 0, 1);
     Function *globalFunc = new Function("0global", std::vector<VariableWrapper>());
-    callStack.push_back(StackFrame(globalFunc, 0, std::vector<Variable>()));
+    callStack.reserve(FRAME_POOL);
+    variables.reserve(VARIABLE_POOL);
+    callStack.push_back(StackFrame(globalFunc, 0, 0));
     current_function = globalFunc;
     current_ops = current_function->getOps();
     allFunctions.push_back(globalFunc);
-    globalExe = this;
     pc = 0;
+    resetDirty();
 }
 
 Executor::~Executor() {
+    delete recorder;
+    delete svg;
+    delete jit;
+    delete stamps;
+    delete culler;
+    delete bands;
+    releaseBuffer();
+    for (size_t i = 0; i < allFunctions.size(); i++)
+        delete allFunctions[i];
 }
 Variable &Executor::getVariableByName(std::string name) {
-    // std::cout << "debug: name=" << name << ", result=";
-
-    Variable *v = nullptr;
-    bool found = false;
-    // check local variables in every stack frame
-    for (auto it = callStack.rbegin(); it != callStack.rend(); it++) {
-        if (found)
-            break;
-        std::vector<Variable> &l_vars = it->localVariables;
-        for (auto it2 = l_vars.begin(); it2 != l_vars.end(); it2++) {
-            if (it2->getName() == name) {
-                v = &(*it2);
-                found = true;
-                break;
-            }
+    int symbol = Variable::findSymbol(name);
+    if (symbol < 0)
+        return Variable::noVar();
+    return getVariableBySymbol(symbol);
+}
+
+// innermost frame first; within a frame the first match wins, like a name scan did
+Variable &Executor::getVariableBySymbol(int symbol) {
+    size_t end = variables.size();
+    for (size_t i = callStack.size(); i-- > 0;) {
+        size_t base = callStack[i].base;
+        for (size_t j = base; j < end; j++) {
+            if (variables[j].getSymbol() == symbol)
+                return variables[j];
         }
+        end = base;
     }
+    return Variable::noVar();
+}
 
-    if (v) {
-        // found
-        return *v;
-    } else {
-        // not found
-        return Variable::noVar();
-    }
+// Both stacks are reserved up front and only grow when a deeper call than ever
+// before needs it, so a call/return pair does not touch the heap. Room for all
+// of the frame's variables is made here, references into the variable stack
+// stay valid while the frame runs.
+void Executor::pushFrame(Function *function, size_t ret_pc, Function *layout) {
+    // the global frame is not a call
+    if (maxCallDepth && callStack.size() > static_cast<size_t>(maxCallDepth))
+        issueLimitError("depth", "calls nested deeper than " + std::to_string(maxCallDepth));
+    size_t need = variables.size() + layout->getFrameSize();
+    if (need > variables.capacity())
+        variables.reserve(std::max(need, 2 * variables.capacity()));
+    callStack.push_back(StackFrame(function, ret_pc, variables.size()));
+}
+
+void Executor::popFrame() {
+    variables.erase(variables.begin() + callStack.back().base, variables.end());
+    callStack.pop_back();
+}
+
+void Executor::setViewport(int x, int y, int w, int h) {
+    hasViewport = true;
+    viewportX = x;
+    viewportY = y;
+    viewportW = w;
+    viewportH = h;
 }
-Variable &Executor::getVariableByNameStatic(std::string name) {
-    return globalExe->getVariableByName(name);
+
+// a buffer of width x height pixels, its contents are set by setBackground
+void Executor::allocateBuffer() {
+    releaseBuffer();
+    size_t bytes = static_cast<size_t>(width) * height * sizeof(Pixel);
+    if (maxCanvasBytes && bytes > maxCanvasBytes)
+        issueLimitError("canvas", "the canvas needs " + std::to_string(bytes) + " bytes, more than the limit of " + std::to_string(maxCanvasBytes));
+    buffer = bufferPool ? bufferPool->acquire(bytes) : new unsigned char[bytes];
+}
+
+void Executor::releaseBuffer() {
+    if (!buffer)
+        return;
+    size_t bytes = static_cast<size_t>(width) * height * sizeof(Pixel);
+    if (bufferPool)
+        bufferPool->release(buffer, bytes);
+    else
+        delete[] buffer;
+    buffer = nullptr;
 }
 
 void Executor::initNewBuffer(int width, int height) {
-    delete buffer;
+    releaseBuffer();
+    if (hasViewport) {
+        // only the part of the viewport that lies on the canvas is rendered
+        int x0 = max(viewportX, 0);
+        int y0 = max(viewportY, 0);
+        int x1 = min(viewportX + viewportW, width);
+        int y1 = min(viewportY + viewportH, height);
+        if (x0 >= x1 || y0 >= y1) {
+            issueRuntimeError("viewport does not overlap the canvas");
+        }
+        originX = x0;
+        originY = y0;
+        width = x1 - x0;
+        height = y1 - y0;
+    }
     this->width = width;
     this->height = height;
-    buffer = new unsigned char[width * height * sizeof(Pixel)];
+    if (svg) {
+        svg->setCanvas(width, height);
+        buffer = nullptr;
+        return;
+    }
+    if (dryRun) {
+        buffer = nullptr;
+        return;
+    }
+    allocateBuffer();
+}
+
+// allocate a buffer for the canvas rectangle at [x, y] of size [width, height]
+void Executor::initBufferAt(int x, int y, int width, int height) {
+    releaseBuffer();
+    originX = x;
+    originY = y;
+    this->width = width;
+    this->height = height;
+    allocateBuffer();
+    setBackground(background.r, background.g, background.b);
 }
 
 void Executor::setBackground(int R, int G, int B) {
     Pixel *pixels = reinterpret_cast<Pixel *>(buffer);
     Pixel fill(R, G, B, 1);
+    background = fill;
+    if (!buffer && !svg) {
+        return;
+    }
+    if (svg) {
+        svg->setBackground(fill);
+        return;
+    }
     for (size_t i = 0; i < width * height; i++) {
         pixels[i] = fill;
     }
@@ -65,6 +205,8 @@ void Executor::setBackground(int R, int G, int B) {
 void Executor::setPenPosition(int x, int y) {
     logical_pen_x = x;
     logical_pen_y = y;
+    start_pen_x = x;
+    start_pen_y = y;
 }
 
 void Executor::def(std::string name, int value, int lineno) {
@@ -157,6 +299,34 @@ void Executor::endFuncDef(int lineno) {
     current_ops = current_function->getOps();
 }
 void Executor::run() {
+    while (step(0))
+        ;
+}
+
+bool Executor::step(long maxOps, unsigned long long maxPixels) {
+    if (finished)
+        return false;
+    if (!started) {
+        started = true;
+        // the DEFs of the global frame
+        if (variables.size() + current_function->getFrameSize() > variables.capacity())
+            variables.reserve(variables.size() + current_function->getFrameSize());
+        if (recorder) {
+            // the first frame is the whole background
+            markDirty(0, 0, width - 1, height - 1);
+            emitFrame();
+        }
+        if (bands)
+            bands->begin();
+        // a run after restart() keeps the deadline of the first
+        if (timeLimitMs && deadline == std::chrono::steady_clock::time_point())
+            deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeLimitMs);
+    }
+    sliceOps = maxOps;
+    slicePixels = maxPixels;
+    opsInSlice = 0;
+    pixelsAtSlice = pixelsDrawn;
+    checkAt = 0;
 
     while (!callStack.empty()) {
         current_function = callStack[callStack.size() - 1].function;
@@ -166,25 +336,637 @@ void Executor::run() {
         if (verbose)
             std::cout << "Execute " << current_function->getName() << " from pc[" << pc << "]" << std::endl;
         while (pc < current_ops->size()) {
+            if (opsInSlice >= checkAt && checkpoint()) {
+                opsBefore += opsInSlice;
+                return true;
+            }
             if (verbose)
                 std::cout << "pc[" << pc << "]: ";
             (*current_ops)[pc]->exec();
             pc++;
+            opsInSlice++;
+            if (recorder) {
+                opsSinceFrame++;
+                if ((frameEveryOps && opsSinceFrame >= frameEveryOps) ||
+                    (frameEveryPixels && pixelsDrawn - pixelsAtFrame >= (unsigned long long)frameEveryPixels)) {
+                    emitFrame();
+                }
+            }
         }
         // frame complete
         if (verbose)
             std::cout << "return from " << current_function->getName() << std::endl;
 
         pc = callStack[callStack.size() - 1].ret_pc + 1;
-        callStack.pop_back();
+        popFrame();
     }
+    // the last lines may be over the pixel limit with no op left to check it
+    checkPixels();
+    finished = true;
+    opsBefore += opsInSlice;
+    sliceOps = 0;
+    slicePixels = 0;
+    if (bands)
+        bands->end();
+
+    if (recorder) {
+        if (dirtyX0 <= dirtyX1)
+            emitFrame();
+        if (verbose)
+            std::cout << recorder->getFrameCount() << " frames recorded" << std::endl;
+        recorder->close();
+    }
+    return false;
 }
-void Executor::step() {
-    bool runOnce = true;
+
+bool Executor::sliceOver() const {
+    return (sliceOps && opsInSlice >= sliceOps) || (slicePixels && pixelsDrawn - pixelsAtSlice >= slicePixels);
 }
 
+// Before the op at opsInSlice == checkAt: stop the program if it is over a
+// resource limit, true if the slice is over, else set checkAt to the next op
+// where either can happen. Without limits or a slice that is never.
+bool Executor::checkpoint() {
+    long long ops = opsBefore + opsInSlice;
+    if (maxOps && ops >= maxOps)
+        issueLimitError("ops", "more than " + std::to_string(maxOps) + " ops executed");
+    checkPixels();
+    if (timeLimitMs && std::chrono::steady_clock::now() >= deadline)
+        issueLimitError("time", "still running after " + std::to_string(timeLimitMs) + " ms");
+    if (sliceOver())
+        return true;
+    long long next = LONG_MAX;
+    if (sliceOps)
+        next = sliceOps;
+    if (slicePixels)
+        next = opsInSlice + 1;
+    if (maxOps)
+        next = std::min<long long>(next, opsInSlice + maxOps - ops);
+    if (timeLimitMs)
+        next = std::min<long long>(next, opsInSlice + CLOCK_CHECK_OPS);
+    checkAt = next;
+    return false;
+}
+
+void Executor::checkPixels() {
+    if (maxPixels && pixelsCharged > maxPixels)
+        issueLimitError("pixels", "more than " + std::to_string(maxPixels) + " pixels drawn");
+}
+
+// How many iterations of a compiled loop to run before the slice ends or the
+// next checkpoint is due, at least one; all of them outside of a slice and
+// without limits. Without a measure of the pixels an iteration draws, one
+// iteration is run to take it.
+int Executor::sliceIterations(int loops, long opsPerIteration, unsigned long long pixelsPerIteration) {
+    long run = loops;
+    if (sliceOps)
+        run = std::min(run, std::max((sliceOps - opsInSlice) / opsPerIteration, 1L));
+    if (maxOps)
+        run = std::min<long long>(run, std::max((maxOps - opsBefore - opsInSlice) / opsPerIteration, 1LL));
+    if (timeLimitMs)
+        run = std::min(run, std::max(CLOCK_CHECK_OPS / opsPerIteration, 1L));
+    if (timeLimitMs && pixelsPerIteration) {
+        long cap = std::max<unsigned long long>(CLOCK_CHECK_PIXELS / pixelsPerIteration, 1);
+        if (cap < run) {
+            // the next op reads the clock
+            run = cap;
+            checkAt = opsInSlice;
+        }
+    }
+    if (maxPixels) {
+        unsigned long long left = pixelsCharged < maxPixels ? maxPixels - pixelsCharged : 0;
+        if (!pixelsPerIteration)
+            run = 1;
+        else
+            run = std::min<long>(run, std::max<unsigned long long>(left / pixelsPerIteration, 1));
+    }
+    if (slicePixels) {
+        unsigned long long drawn = pixelsDrawn - pixelsAtSlice;
+        unsigned long long left = drawn < slicePixels ? slicePixels - drawn : 0;
+        if (!pixelsPerIteration)
+            run = 1;
+        else
+            run = std::min<long>(run, std::max<unsigned long long>(left / pixelsPerIteration, 1));
+    }
+    return run;
+}
+
+// the effect of a MOVE op
+void Executor::moveTurtle(int steps) {
+    if (clocked) {
+        logical_pen_x += steps * headingCos();
+        logical_pen_y += steps * headingSin();
+    } else if (svg) {
+        vectorMove(steps);
+    } else if (dryRun) {
+        traceLine(steps);
+    } else {
+        // do some real drawing
+        drawLine(steps);
+    }
+}
+
+// the effect of a TURN op, degree may leave [0, 359] for large negative turns
+void Executor::turnTurtle(int degrees) {
+    degree -= degrees;
+    if (verbose) {
+        std::cout << "\tdegree state: " << degree << std::endl;
+    }
+    degree = (degree + 360) % 360;
+}
+
+// the effect of a COLOR op
+void Executor::setPenColorValue(int r, int g, int b) {
+    if (r > 255 || g > 255 || b > 255 || r < 0 || g < 0 || b < 0) {
+        issueRuntimeWarning("Color value out of range, value larger than 255 will be set to 255, value smaller than 0 will be set 0");
+    }
+    r = min(r, 255);
+    r = max(r, 0);
+    g = min(g, 255);
+    g = max(g, 0);
+    b = min(b, 255);
+    b = max(b, 0);
+
+    penColor = Pixel(r, g, b, 1);
+    clocked = false;
+}
+
+// reported like a scanner error, on the line the scanner stopped at
+void Executor::issueError(const char *text) {
+    throw LogoError("Error at line " + std::to_string(lastLine) + ": " + text, true);
+}
+
+// the effect of a PENWIDTH op
+void Executor::setPenWidthValue(int w) {
+    if (w > 0)
+        penWidth = w;
+    else {
+        issueError("Pen width should be larger than 1");
+    }
+}
+
+// x, y are canvas coordinates
 void Executor::drawPixel(int x, int y) {
-    getBufferPixel(x, y) = penColor;
+    x -= originX;
+    y -= originY;
+    if (0 <= x && x < width && 0 <= y && y < height) {
+        Pixel *p = reinterpret_cast<Pixel *>(buffer);
+        p[y * width + x] = penColor;
+        markDirty(x, y, x, y);
+        pixelsDrawn++;
+    }
+}
+
+// draw pixels [x0, x1] of canvas row y with the pen color
+void Executor::fillSpan(int y, int x0, int x1) {
+    y -= originY;
+    x0 -= originX;
+    x1 -= originX;
+    if (y < 0 || y >= height)
+        return;
+    if (x0 < 0)
+        x0 = 0;
+    if (x1 >= width)
+        x1 = width - 1;
+    if (x0 > x1)
+        return;
+    Pixel *p = reinterpret_cast<Pixel *>(buffer) + y * width;
+    for (int x = x0; x <= x1; x++) {
+        p[x] = penColor;
+    }
+    markDirty(x0, y, x1, y);
+    pixelsDrawn += x1 - x0 + 1;
+}
+
+// Shrink the step range [first, last) of a line to the steps whose pen
+// footprint can touch the buffer along one axis. [lo, hi] is the visible
+// range of pen positions on that axis, pos + i * d is the position of step i.
+void Executor::clipSteps(double pos, double d, double lo, double hi, int &first, int &last) {
+    if (std::fabs(d) < 1e-9) {
+        if (pos < lo || pos > hi)
+            last = first;
+        return;
+    }
+    double t0 = (lo - pos) / d;
+    double t1 = (hi - pos) / d;
+    if (t0 > t1)
+        std::swap(t0, t1);
+    // one step of slack on both sides covers the accumulated rounding
+    if (t0 - 1 > first)
+        first = t0 - 1 > last ? last : static_cast<int>(t0 - 1);
+    if (t1 + 2 < last)
+        last = t1 + 2 < first ? first : static_cast<int>(t1 + 2);
+}
+
+// The columns [lo, hi] a square of radius half at p covers and the one at prev
+// did not, prev == INT_MIN when there is no previous square
+static inline void newSpan(int p, int prev, int half, int &lo, int &hi) {
+    lo = p - half;
+    hi = p + half;
+    if (prev == INT_MIN)
+        return;
+    if (p > prev)
+        lo = max(lo, prev + half + 1);
+    else if (p < prev)
+        hi = min(hi, prev - half - 1);
+    else
+        hi = lo - 1;
+}
+
+// Whether every pen footprint of a line along one axis is inside the buffer.
+// One pixel of slack covers the rounding and the error the repeated additions
+// accumulate against pos + i * d; negative positions are left to the clipping
+// kernels, where the cast to int does not round down.
+static bool spanInside(double pos, double d, int steps, int half, int origin, int size) {
+    double end = pos + (steps - 1) * d;
+    double lo = std::min(pos, end);
+    double hi = std::max(pos, end);
+    return lo >= 0 && lo - 1.0 - half >= origin && hi + 1.0 + half <= origin + size;
+}
+
+// Rasterize steps [first, last) of a drawing MOVE of [steps] pixels, the other
+// steps are only walked. HALF is the pen radius, PEN_LARGE for one only known
+// at run time. A horizontal or vertical HEADING means the other coordinate is a
+// fixed point of its addition, so it is neither added nor rounded per step.
+// Without CLIP every footprint is known to be inside the buffer: nothing is
+// bounds checked, and along an axis only the pixels the previous footprint did
+// not cover are stored (they have the same color), while pixelsDrawn still
+// counts whole footprints as fillSpan does.
+template <int HALF, int HEADING, bool CLIP>
+void Executor::strokeLine(int steps, int first, int last, double dx, double dy) {
+    const int half = HALF == PEN_LARGE ? penWidth / 2 : HALF;
+    double x = logical_pen_x;
+    double y = logical_pen_y;
+    int i = 0;
+    for (; i < first; i++) {
+        if (HEADING != HEADING_VERTICAL)
+            x += dx;
+        if (HEADING != HEADING_HORIZONTAL)
+            y += dy;
+    }
+    if (CLIP) {
+        for (; i < last; i++) {
+            int px = static_cast<int>(x + 0.5);
+            int py = static_cast<int>(y + 0.5);
+            for (int row = py - half; row < py + half + 1; row++)
+                fillSpan(row, px - half, px + half);
+            if (HEADING != HEADING_VERTICAL)
+                x += dx;
+            if (HEADING != HEADING_HORIZONTAL)
+                y += dy;
+        }
+    } else if (first < last) {
+        Pixel *pixels = reinterpret_cast<Pixel *>(buffer);
+        const Pixel color = penColor;
+        int x0 = static_cast<int>(x + 0.5) - originX;
+        int y0 = static_cast<int>(y + 0.5) - originY;
+        int px = x0;
+        int py = y0;
+        if (HEADING == HEADING_HORIZONTAL) {
+            Pixel *row = pixels + py * width;
+            if (HALF == 0) {
+                for (; i < last; i++) {
+                    px = static_cast<int>(x + 0.5) - originX;
+                    row[px] = color;
+                    x += dx;
+                }
+            } else {
+                int prev = INT_MIN;
+                for (; i < last; i++) {
+                    px = static_cast<int>(x + 0.5) - originX;
+                    int lo, hi;
+                    newSpan(px, prev, half, lo, hi);
+                    for (int r = -half; r <= half; r++) {
+                        for (int c = lo; c <= hi; c++)
+                            row[r * width + c] = color;
+                    }
+                    prev = px;
+                    x += dx;
+                }
+            }
+        } else if (HEADING == HEADING_VERTICAL) {
+            int prev = INT_MIN;
+            for (; i < last; i++) {
+                py = static_cast<int>(y + 0.5) - originY;
+                int lo, hi;
+                newSpan(py, prev, half, lo, hi);
+                for (int r = lo; r <= hi; r++) {
+                    Pixel *row = pixels + r * width;
+                    for (int c = px - half; c <= px + half; c++)
+                        row[c] = color;
+                }
+                prev = py;
+                y += dy;
+            }
+        } else {
+            for (; i < last; i++) {
+                px = static_cast<int>(x + 0.5) - originX;
+                py = static_cast<int>(y + 0.5) - originY;
+                for (int r = py - half; r <= py + half; r++) {
+                    Pixel *row = pixels + r * width;
+                    for (int c = px - half; c <= px + half; c++)
+                        row[c] = color;
+                }
+                x += dx;
+                y += dy;
+            }
+        }
+        // the pen moves monotonically, the first and the last footprint bound the line
+        markDirty(min(x0, px) - half, min(y0, py) - half, max(x0, px) + half, max(y0, py) + half);
+        pixelsDrawn += static_cast<unsigned long long>(last - first) * (2 * half + 1) * (2 * half + 1);
+    }
+    for (; i < steps; i++) {
+        if (HEADING != HEADING_VERTICAL)
+            x += dx;
+        if (HEADING != HEADING_HORIZONTAL)
+            y += dy;
+    }
+    logical_pen_x = x;
+    logical_pen_y = y;
+}
+
+template <int HALF>
+Executor::StrokeKernel Executor::selectStroke(int heading, bool clip) {
+    switch (heading) {
+    case HEADING_HORIZONTAL:
+        return clip ? &Executor::strokeLine<HALF, HEADING_HORIZONTAL, true> : &Executor::strokeLine<HALF, HEADING_HORIZONTAL, false>;
+    case HEADING_VERTICAL:
+        return clip ? &Executor::strokeLine<HALF, HEADING_VERTICAL, true> : &Executor::strokeLine<HALF, HEADING_VERTICAL, false>;
+    default:
+        return clip ? &Executor::strokeLine<HALF, HEADING_GENERAL, true> : &Executor::strokeLine<HALF, HEADING_GENERAL, false>;
+    }
+}
+
+// Rasterize a drawing MOVE of [steps] pixels from the current pen position.
+// Steps whose pen footprint cannot reach the buffer are only walked, not drawn,
+// so the turtle ends at exactly the same position as if everything was drawn.
+// The pen state is read once here to pick the kernel for the whole line.
+void Executor::drawLine(int steps) {
+    if (steps <= 0)
+        return;
+    if (maxPixels && !chargePixels(static_cast<unsigned long long>(steps) * (penWidth / 2 * 2 + 1) * (penWidth / 2 * 2 + 1)))
+        return;
+    if (bands && bands->isRecording()) {
+        bands->recordLine(steps);
+        return;
+    }
+    double dx = headingCos();
+    double dy = headingSin();
+    int half = penWidth / 2;
+    int heading = HEADING_GENERAL;
+    if (logical_pen_y + dy == logical_pen_y)
+        heading = HEADING_HORIZONTAL;
+    else if (logical_pen_x + dx == logical_pen_x)
+        heading = HEADING_VERTICAL;
+    int first = 0;
+    int last = steps;
+    bool clip = !spanInside(logical_pen_x, dx, steps, half, originX, width) || !spanInside(logical_pen_y, dy, steps, half, originY, height);
+    if (clip) {
+        // positions in (-1.5, 0.5) round to pixel 0, as the cast truncates towards zero
+        clipSteps(logical_pen_x, dx, originX - half - 2.0, originX + width + half + 1.0, first, last);
+        clipSteps(logical_pen_y, dy, originY - half - 2.0, originY + height + half + 1.0, first, last);
+        if (last < first)
+            last = first;
+    }
+
+    StrokeKernel kernel;
+    switch (half) {
+    case 0:
+        kernel = selectStroke<0>(heading, clip);
+        break;
+    case 1:
+        kernel = selectStroke<1>(heading, clip);
+        break;
+    case 2:
+        kernel = selectStroke<2>(heading, clip);
+        break;
+    case 3:
+        kernel = selectStroke<3>(heading, clip);
+        break;
+    default:
+        kernel = selectStroke<PEN_LARGE>(heading, clip);
+        break;
+    }
+    (this->*kernel)(steps, first, last, dx, dy);
+}
+
+// Same as "COLOR c / MOVE 1" for every color in [colors]
+void Executor::drawPixelRun(const Pixel *colors, size_t count) {
+    if (count == 0)
+        return;
+    clocked = false;
+    if (svg || dryRun || penWidth / 2 != 0) {
+        for (size_t i = 0; i < count; i++) {
+            penColor = colors[i];
+            if (svg)
+                vectorMove(1);
+            else if (dryRun)
+                traceLine(1);
+            else
+                drawLine(1);
+        }
+        return;
+    }
+    if (maxPixels && !chargePixels(count))
+        return;
+
+    if (bands && bands->isRecording()) {
+        bands->recordRun(colors, count);
+        return;
+    }
+
+    // pen width 1: one bounds check and one store per pixel
+    double dx = headingCos();
+    double dy = headingSin();
+    double pen_x = logical_pen_x;
+    double pen_y = logical_pen_y;
+    Pixel *pixels = reinterpret_cast<Pixel *>(buffer);
+    int x0 = INT_MAX, y0 = INT_MAX, x1 = INT_MIN, y1 = INT_MIN;
+    size_t drawn = 0;
+    for (size_t i = 0; i < count; i++) {
+        int x = static_cast<int>(pen_x + 0.5) - originX;
+        int y = static_cast<int>(pen_y + 0.5) - originY;
+        if (0 <= x && x < width && 0 <= y && y < height) {
+            pixels[y * width + x] = colors[i];
+            x0 = min(x0, x);
+            y0 = min(y0, y);
+            x1 = max(x1, x);
+            y1 = max(y1, y);
+            drawn++;
+        }
+        pen_x += dx;
+        pen_y += dy;
+    }
+    logical_pen_x = pen_x;
+    logical_pen_y = pen_y;
+    penColor = colors[count - 1];
+    if (drawn) {
+        markDirty(x0, y0, x1, y1);
+        pixelsDrawn += drawn;
+    }
+}
+
+void Executor::resetDirty() {
+    dirtyX0 = INT_MAX;
+    dirtyY0 = INT_MAX;
+    dirtyX1 = INT_MIN;
+    dirtyY1 = INT_MIN;
+}
+
+bool Executor::startAnimation(std::string filename, long everyOps, long everyPixels) {
+    delete recorder;
+    recorder = new FrameRecorder();
+    if (!recorder->open(filename, width, height)) {
+        delete recorder;
+        recorder = nullptr;
+        return false;
+    }
+    frameEveryOps = everyOps;
+    frameEveryPixels = everyPixels;
+    return true;
+}
+
+void Executor::startVectorOutput() {
+    if (!svg)
+        svg = new SvgWriter();
+}
+
+// emit one stroke instead of rasterizing it
+void Executor::vectorMove(int steps) {
+    if (steps <= 0)
+        return;
+    double x0 = logical_pen_x;
+    double y0 = logical_pen_y;
+    logical_pen_x += steps * headingCos();
+    logical_pen_y += steps * headingSin();
+    svg->segment(x0, y0, logical_pen_x, logical_pen_y, penColor, penWidth);
+}
+
+// false if machine code cannot be generated on this platform, everything is interpreted then
+bool Executor::startJit(bool perfMap) {
+    if (!Jit::isSupported())
+        return false;
+    if (!jit)
+        jit = new Jit();
+    if (perfMap && !jit->openPerfMap())
+        issueRuntimeWarning("cannot write the perf map");
+    return true;
+}
+
+void Executor::startCulling() {
+    if (!culler)
+        culler = new CallCuller(this);
+}
+
+// after startCulling, the cache shares the call summaries of the culler
+void Executor::startStampCache(size_t capacity) {
+    if (!stamps)
+        stamps = new StampCache(this, capacity);
+}
+
+// compiled loops are rasterized on [threads] threads; front to back, all
+// drawing is deferred to the end of the run and stored once per pixel
+void Executor::startBands(int threads, bool frontToBack) {
+    if (!bands)
+        bands = new BandRenderer(this, threads, frontToBack);
+}
+
+void Executor::startDryRun() {
+    dryRun = true;
+    drawnX0 = INT_MAX;
+    drawnY0 = INT_MAX;
+    drawnX1 = INT_MIN;
+    drawnY1 = INT_MIN;
+    pathLength = 0;
+    estimatedPixels = 0;
+}
+
+// measure a drawing MOVE, the pen walks exactly as in drawLine
+void Executor::traceLine(int steps) {
+    if (steps <= 0)
+        return;
+    double dx = headingCos();
+    double dy = headingSin();
+    int half = penWidth / 2;
+    int first_x = static_cast<int>(logical_pen_x + 0.5);
+    int first_y = static_cast<int>(logical_pen_y + 0.5);
+    int last_x = first_x;
+    int last_y = first_y;
+    for (int i = 0; i < steps; i++) {
+        last_x = static_cast<int>(logical_pen_x + 0.5);
+        last_y = static_cast<int>(logical_pen_y + 0.5);
+        logical_pen_x += dx;
+        logical_pen_y += dy;
+    }
+    // pixel positions are monotonic along a line, the ends bound it
+    drawnX0 = min(drawnX0, min(first_x, last_x) - half);
+    drawnY0 = min(drawnY0, min(first_y, last_y) - half);
+    drawnX1 = max(drawnX1, max(first_x, last_x) + half);
+    drawnY1 = max(drawnY1, max(first_y, last_y) + half);
+    pathLength += steps;
+    estimatedPixels += (unsigned long long)steps * (2 * half + 1) * (2 * half + 1);
+}
+
+bool Executor::getDrawnBox(int &x0, int &y0, int &x1, int &y1) {
+    x0 = drawnX0;
+    y0 = drawnY0;
+    x1 = drawnX1;
+    y1 = drawnY1;
+    return x0 <= x1 && y0 <= y1;
+}
+
+void Executor::printDryRunReport() {
+    int x0, y0, x1, y1;
+    if (getDrawnBox(x0, y0, x1, y1)) {
+        std::cout << "bounding box: [" << x0 << "," << y0 << "] - [" << x1 << "," << y1 << "], "
+                  << x1 - x0 + 1 << "x" << y1 - y0 + 1 << std::endl;
+    } else {
+        std::cout << "bounding box: empty" << std::endl;
+    }
+    std::cout << "final turtle: position [" << logical_pen_x << "," << logical_pen_y << "], heading " << degree
+              << ", color [" << (int)penColor.r << "," << (int)penColor.g << "," << (int)penColor.b << "]"
+              << ", pen width " << penWidth << (clocked ? ", cloaked" : "") << std::endl;
+    std::cout << "path length: " << pathLength << std::endl;
+    std::cout << "estimated pixel writes: " << estimatedPixels << std::endl;
+}
+
+// reset the turtle and the call stack so the program can run again
+void Executor::restart() {
+    Function *globalFunc = allFunctions[0];
+    callStack.clear();
+    variables.clear();
+    callStack.push_back(StackFrame(globalFunc, 0, 0));
+    current_function = globalFunc;
+    current_ops = current_function->getOps();
+    pc = 0;
+    logical_pen_x = start_pen_x;
+    logical_pen_y = start_pen_y;
+    degree = 90;
+    clocked = false;
+    penColor = Pixel(0, 0, 0, 1);
+    penWidth = 1;
+    dryRun = false;
+    pixelsDrawn = 0;
+    pixelsCharged = 0;
+    opsBefore = 0;
+    started = finished = false;
+    resetDirty();
+}
+
+// 0: no limit; the deadline is taken when the program starts to run
+void Executor::setLimits(size_t canvasBytes, long long ops, unsigned long long pixels, int callDepth, long timeMs) {
+    maxCanvasBytes = canvasBytes;
+    maxOps = ops;
+    maxPixels = pixels;
+    maxCallDepth = callDepth;
+    timeLimitMs = timeMs;
+}
+
+void Executor::emitFrame() {
+    recorder->writeFrame(buffer, dirtyX0, dirtyY0, dirtyX1, dirtyY1);
+    resetDirty();
+    opsSinceFrame = 0;
+    pixelsAtFrame = pixelsDrawn;
 }
 
 Pixel &Executor::getBufferPixel(int x, int y) {
@@ -199,16 +981,25 @@ Pixel &Executor::getBufferPixel(int x, int y) {
     }
 }
 
-void Executor::writeFile(std::string filename) {
+// false if the file cannot be written
+bool Executor::writeFile(std::string filename, int mipmapMinSize) {
+    if (svg)
+        return svg->WriteSVG(filename) != 0;
     FileWriter writer;
+    writer.setMipmap(mipmapMinSize);
     auto sz = writer.WriteBMP(filename, this->buffer, width, height);
     if (verbose)
         std::cout << "write file return value: " << sz << std::endl;
-    if (sz) {
-        std::cout << "write to file " << filename << std::endl;
-    } else {
-        std::cerr << "cannot write to file " << filename << std::endl;
+    return sz != 0;
+}
+
+void Executor::encodeImage(std::string &image) {
+    if (svg) {
+        svg->EncodeSVG(image);
+        return;
     }
+    FileWriter writer;
+    writer.EncodeBMP(image, this->buffer, width, height);
 }
 
 void Executor::call(std::string name, std::vector<VariableWrapper> paraList, int lineno) {
@@ -227,6 +1018,3 @@ void Executor::fill(int lineno) {
     op = new FillOp(this, lineno);
     current_ops->push_back(op);
 }
-
-StackFrame::~StackFrame() {
-}
\ No newline at end of file
@@ -4,11 +4,19 @@
 #include "Op.h"
 #include "Pixel.h"
 #include "Variable.h"
+#include <chrono>
 #include <cmath>
 #include <stack>
 #include <vector>
 #include "StackFrame.h"
 class OpsQueue;
+class FrameRecorder;
+class SvgWriter;
+class Jit;
+class CallCuller;
+class StampCache;
+class BandRenderer;
+class BufferPool;
 class Function;
 const double PI = 3.14159265359;
 class Executor
@@ -25,10 +33,26 @@ class Executor
     friend class CallOp;
     friend class FillOp;
     friend class SetPenWidthOp;
+    friend class PixelRunOp;
+    friend class LoopKernel;
+    friend class InlineCallOp;
+    friend class InlineReturnOp;
+    friend class Optimizer;
+    friend class CppEmitter;
+    friend class Jit;
+    friend class Verifier;
+    friend class CallCuller;
+    friend class CostEstimator;
+    friend class Program;
+    friend class Bytecode;
+    friend class StampCache;
+    friend class BandRenderer;
 
 private:
-    static Executor *globalExe;
     unsigned char *buffer = nullptr;    // pixels
+    BufferPool *bufferPool = nullptr;   // where buffer comes from and goes back to, nullptr: the heap
+    void allocateBuffer();
+    void releaseBuffer();
 
     double logical_pen_x;
     double logical_pen_y;
@@ -41,20 +65,120 @@ private:
     Function *current_function;
     std::vector<Op *> *current_ops; // change together
     std::vector<StackFrame> callStack;
+    std::vector<Variable> variables; // locals of every frame, the top frame last
+    void pushFrame(Function *function, size_t ret_pc, Function *layout);
+    void popFrame();
     bool clocked = false;
     Pixel penColor;
     Pixel &getBufferPixel(int x, int y);
-    int width;
+    int width;  // size of the pixel buffer
     int height;
+    int originX = 0; // canvas position of buffer pixel (0, 0), non-zero for a viewport
+    int originY = 0;
+    bool hasViewport = false;
+    int viewportX, viewportY, viewportW, viewportH;
     int penWidth=1;
     Pixel _noPixel; // a special pixel, all invalid pixels point to this
+
+    // dirty rectangle since the last frame, inclusive, empty when x0 > x1
+    int dirtyX0, dirtyY0, dirtyX1, dirtyY1;
+    unsigned long long pixelsDrawn = 0;
+
+    // animation export
+    FrameRecorder *recorder = nullptr;
+    long frameEveryOps = 0;
+    long frameEveryPixels = 0;
+    long opsSinceFrame = 0;
+    unsigned long long pixelsAtFrame = 0;
+    void resetDirty();
+    void markDirty(int x0, int y0, int x1, int y1) {
+        if (x0 < dirtyX0) dirtyX0 = x0;
+        if (y0 < dirtyY0) dirtyY0 = y0;
+        if (x1 > dirtyX1) dirtyX1 = x1;
+        if (y1 > dirtyY1) dirtyY1 = y1;
+    }
+    void emitFrame();
+
+    // vector output, no pixel buffer is allocated when set
+    SvgWriter *svg = nullptr;
+    void vectorMove(int steps);
+
+    // dry run: no pixel buffer, drawing moves are only measured
+    bool dryRun = false;
+    int drawnX0, drawnY0, drawnX1, drawnY1; // bounding box of the pixels that would be drawn
+    double pathLength = 0;
+    unsigned long long estimatedPixels = 0;
+    void traceLine(int steps);
+
+    // drawLine kernels, specialized on the pen radius, the heading and clipping
+    enum { PEN_LARGE = -1 };
+    enum { HEADING_GENERAL, HEADING_HORIZONTAL, HEADING_VERTICAL };
+    typedef void (Executor::*StrokeKernel)(int steps, int first, int last, double dx, double dy);
+    template <int HALF, int HEADING, bool CLIP>
+    void strokeLine(int steps, int first, int last, double dx, double dy);
+    template <int HALF>
+    static StrokeKernel selectStroke(int heading, bool clip);
+    static void clipSteps(double pos, double d, double lo, double hi, int &first, int &last);
+
+    // machine code for hot loops and functions, nullptr when disabled
+    Jit *jit = nullptr;
+
+    // skips calls that only draw outside the buffer, nullptr when disabled
+    CallCuller *culler = nullptr;
+    // copies the pixels of calls that repeat a motif, nullptr when disabled
+    StampCache *stamps = nullptr;
+    // rasterizes the lines of compiled loops in bands on several threads, nullptr when disabled
+    BandRenderer *bands = nullptr;
+
+    // the slice of step() being run, limits of 0 mean none
+    bool started = false;
+    bool finished = false;
+    long sliceOps = 0;
+    unsigned long long slicePixels = 0;
+    long opsInSlice = 0;
+    unsigned long long pixelsAtSlice = 0;
+    bool sliceOver() const;
+    bool isSliced() const { return sliceOps || slicePixels; }
+    int sliceIterations(int loops, long opsPerIteration, unsigned long long pixelsPerIteration);
+    void countSliceOps(long ops) { opsInSlice += ops; }
+
+    // resource limits, see Options; checkpoint() runs when opsInSlice reaches checkAt
+    size_t maxCanvasBytes = 0;
+    long long maxOps = 0;
+    unsigned long long maxPixels = 0;
+    int maxCallDepth = 0;
+    long timeLimitMs = 0;
+    std::chrono::steady_clock::time_point deadline;
+    long long opsBefore = 0;                // ops of the slices before this one
+    unsigned long long pixelsCharged = 0;   // footprint pixels of every line drawn, with maxPixels
+    long checkAt = 0;
+    bool checkpoint();
+    void checkPixels();
+    // false once the pixels are over the limit, nothing more is drawn then;
+    // the error is thrown at the next checkpoint, as the JIT cannot unwind
+    bool chargePixels(unsigned long long pixels) {
+        pixelsCharged += pixels;
+        if (pixelsCharged <= maxPixels)
+            return true;
+        checkAt = 0;
+        return false;
+    }
+
+    Pixel background;
+    int lastLine = 0; // where the scanner stopped, errors found after parsing are reported there
+    void issueError(const char *text);
+    double start_pen_x = 0;
+    double start_pen_y = 0;
 public:
     Executor();
     ~Executor();
-    static Variable &getVariableByNameStatic(std::string name);
     Variable &getVariableByName(std::string name);
+    Variable &getVariableBySymbol(int symbol);
     void run();
-    void step();
+    // run the program for at most maxOps ops, or until maxPixels more pixels
+    // are drawn (0: no limit), and return; the call stack, loop counters and
+    // pen stay here for the next call. False once the program has finished
+    bool step(long maxOps, unsigned long long maxPixels = 0);
 
     void initNewBuffer(int width, int height);
     void setBackground(int R, int G, int B);
@@ -75,8 +199,33 @@ public:
     void endLoop( int lineno = -1);
     void startFuncDef(std::string name, std::vector<VariableWrapper> list, int lineno = -1);
     void endFuncDef( int lineno = -1);
+    void setViewport(int x, int y, int w, int h);
     void drawPixel(int x, int y);
-    void writeFile(std::string filename);
+    void fillSpan(int y, int x0, int x1);
+    void drawLine(int steps);
+    double headingCos() const;
+    double headingSin() const;
+    static double degreeCos(int degree);
+    static double degreeSin(int degree);
+    void moveTurtle(int steps);
+    void turnTurtle(int degrees);
+    void setPenColorValue(int r, int g, int b);
+    void setPenWidthValue(int w);
+    void drawPixelRun(const Pixel *colors, size_t count);
+    bool startAnimation(std::string filename, long everyOps, long everyPixels);
+    void startVectorOutput();
+    void startDryRun();
+    bool startJit(bool perfMap);
+    void startCulling();
+    void startStampCache(size_t capacity);
+    void startBands(int threads, bool frontToBack);
+    bool getDrawnBox(int &x0, int &y0, int &x1, int &y1);
+    void printDryRunReport();
+    void restart();
+    void setLimits(size_t canvasBytes, long long ops, unsigned long long pixels, int callDepth, long timeMs);
+    void initBufferAt(int x, int y, int width, int height);
+    bool writeFile(std::string filename, int mipmapMinSize = 0);
+    void encodeImage(std::string &image); // what writeFile would write, without the pyramid
     void call(std::string name, std::vector<VariableWrapper> paraList, int lineno = -1);
 };
 
@@ -1,39 +1,20 @@
 #include "FileWriter.h"
-#include "Pixel.h"
+#include <algorithm>
+#include <iostream>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 FileWriter::FileWriter() {
 }
 
 FileWriter::~FileWriter() {
+    closeLevels();
 }
 
-size_t FileWriter::WriteBMP(std::string filename, const unsigned char *data, int width, int height) {
-    FILE *fp;
-    fp = fopen(filename.c_str(), "wb");
-    if (!fp) {
-        return 0;
-    }
-    unsigned char *img = nullptr;
-    const Pixel *pixels = reinterpret_cast<const Pixel *>(data);
-    img = new unsigned char[3 * width * height];
+void FileWriter::encodeHeader(unsigned char *header, int width, int height) {
     int size = width * height * sizeof(Pixel);
-    int x, y;
-    for (int i = 0; i < width; i++) {
-        for (int j = 0; j < height; j++) {
-            x = i;
-            y = (height - 1) - j;
-            unsigned char r = pixels[j * width + i].r;
-            unsigned char g = pixels[j * width + i].g;
-            unsigned char b = pixels[j * width + i].b;
-
-            img[(x + y * width) * 3 + 2] = r;
-            img[(x + y * width) * 3 + 1] = g;
-            img[(x + y * width) * 3 + 0] = b;
-        }
-    }
-
     unsigned char bmpfileheader[14] = {'B', 'M', 0, 0, 0, 0, 0, 0, 0, 0, 54, 0, 0, 0};
     unsigned char bmpinfoheader[40] = {40, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 24, 0};
-    unsigned char bmppad[3] = {0, 0, 0};
 
     bmpfileheader[2] = (unsigned char)(size);
     bmpfileheader[3] = (unsigned char)(size >> 8);
@@ -49,14 +30,162 @@ size_t FileWriter::WriteBMP(std::string filename, const unsigned char *data, int
     bmpinfoheader[10] = (unsigned char)(height >> 16);
     bmpinfoheader[11] = (unsigned char)(height >> 24);
 
-    fwrite(bmpfileheader, 1, 14, fp);
-    fwrite(bmpinfoheader, 1, 40, fp);
+    std::copy(bmpfileheader, bmpfileheader + 14, header);
+    std::copy(bmpinfoheader, bmpinfoheader + 40, header + 14);
+}
+
+void FileWriter::writeHeader(FILE *fp, int width, int height) {
+    unsigned char header[HEADER_SIZE];
+    encodeHeader(header, width, height);
+    fwrite(header, 1, HEADER_SIZE, fp);
+}
+
+// bmp rows are stored bottom-up as BGR, which is also the order of our buffer
+// rows; each is padded to a multiple of 4 bytes
+void FileWriter::encodeRow(const Pixel *row, int width) {
+    encoded.assign((3 * (size_t)width + 3) / 4 * 4, 0);
+    unsigned char *img = encoded.data();
+    for (int x = 0; x < width; x++) {
+        img[x * 3 + 2] = row[x].r;
+        img[x * 3 + 1] = row[x].g;
+        img[x * 3 + 0] = row[x].b;
+    }
+}
+
+void FileWriter::writeRow(FILE *fp, const Pixel *row, int width) {
+    encodeRow(row, width);
+    fwrite(encoded.data(), 1, encoded.size(), fp);
+}
+
+// 2x2 box filter: out[i] is the rounded average of row0/row1 pixels 2i and 2i+1
+void FileWriter::downsampleRow(const Pixel *row0, const Pixel *row1, Pixel *out, int outWidth) {
+    const unsigned char *a = reinterpret_cast<const unsigned char *>(row0);
+    const unsigned char *b = reinterpret_cast<const unsigned char *>(row1);
+    unsigned char *o = reinterpret_cast<unsigned char *>(out);
+    int i = 0;
+#if defined(__SSE2__)
+    // 4 source pixels (16 bytes) of each row give 2 output pixels
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i two = _mm_set1_epi16(2);
+    for (; i + 2 <= outWidth; i += 2) {
+        __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + 8 * i));
+        __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + 8 * i));
+        __m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(va, zero), _mm_unpacklo_epi8(vb, zero));
+        __m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(va, zero), _mm_unpackhi_epi8(vb, zero));
+        lo = _mm_add_epi16(lo, _mm_srli_si128(lo, 8));
+        hi = _mm_add_epi16(hi, _mm_srli_si128(hi, 8));
+        __m128i sum = _mm_unpacklo_epi64(lo, hi);
+        sum = _mm_srli_epi16(_mm_add_epi16(sum, two), 2);
+        _mm_storel_epi64(reinterpret_cast<__m128i *>(o + 4 * i), _mm_packus_epi16(sum, zero));
+    }
+#endif
+    for (; i < outWidth; i++) {
+        for (int c = 0; c < 4; c++) {
+            int sum = a[8 * i + c] + a[8 * i + 4 + c] + b[8 * i + c] + b[8 * i + 4 + c];
+            o[4 * i + c] = (unsigned char)((sum + 2) >> 2);
+        }
+    }
+}
+
+bool FileWriter::openLevels(std::string filename, int width, int height) {
+    std::string base = filename;
+    if (base.size() > 4 && (base.compare(base.size() - 4, 4, ".bmp") == 0 || base.compare(base.size() - 4, 4, ".BMP") == 0)) {
+        base.erase(base.size() - 4);
+    }
+    int w = width / 2;
+    int h = height / 2;
+    int minSize = mipmapMinSize > 0 ? mipmapMinSize : 1;
+    while (w >= minSize && h >= minSize) {
+        MipLevel level;
+        level.filename = base + "_" + std::to_string(levels.size() + 1) + ".bmp";
+        level.fp = fopen(level.filename.c_str(), "wb");
+        if (!level.fp) {
+            return false;
+        }
+        level.width = w;
+        level.height = h;
+        level.rowsWritten = 0;
+        level.pendingRows = 0;
+        level.band.resize(4 * (size_t)w);
+        level.row.resize(w);
+        writeHeader(level.fp, w, h);
+        levels.push_back(level);
+        w /= 2;
+        h /= 2;
+    }
+    return true;
+}
+
+// false if any level failed to write
+bool FileWriter::closeLevels() {
+    bool ok = true;
+    for (size_t i = 0; i < levels.size(); i++) {
+        if (levels[i].fp) {
+            ok = !ferror(levels[i].fp) && ok;
+            ok = fclose(levels[i].fp) == 0 && ok;
+            if (verbose)
+                std::cout << "write mipmap " << levels[i].filename << " [" << levels[i].width << "x" << levels[i].height << "]" << std::endl;
+        }
+    }
+    levels.clear();
+    return ok;
+}
+
+// feed one row of the parent of pyramid level [level], cascading down the pyramid
+void FileWriter::pushRow(size_t level, const Pixel *row) {
+    if (level >= levels.size())
+        return;
+    MipLevel &l = levels[level];
+    if (l.rowsWritten >= l.height)
+        return; // odd trailing row of the parent
+    // keep the even columns pairs of the parent row in the band
+    std::copy(row, row + 2 * l.width, l.band.begin() + l.pendingRows * 2 * l.width);
+    if (++l.pendingRows < 2)
+        return;
+    l.pendingRows = 0;
+    downsampleRow(&l.band[0], &l.band[2 * l.width], &l.row[0], l.width);
+    writeRow(l.fp, &l.row[0], l.width);
+    l.rowsWritten++;
+    pushRow(level + 1, &l.row[0]);
+}
+
+size_t FileWriter::WriteBMP(std::string filename, const unsigned char *data, int width, int height) {
+    FILE *fp;
+    fp = fopen(filename.c_str(), "wb");
+    if (!fp) {
+        return 0;
+    }
+    const Pixel *pixels = reinterpret_cast<const Pixel *>(data);
+    if (mipmapMinSize > 0 && !openLevels(filename, width, height)) {
+        closeLevels();
+        fclose(fp);
+        return 0;
+    }
+
+    writeHeader(fp, width, height);
     for (int i = 0; i < height; i++) {
-        fwrite(img + (width * (height - i - 1) * 3), 3, width, fp);
-        fwrite(bmppad, 1, (4 - (width * 3) % 4) % 4, fp);
+        const Pixel *row = pixels + (size_t)i * width;
+        writeRow(fp, row, width);
+        pushRow(0, row);
     }
 
-    delete img;
-    fclose(fp);
-    return 1;
+    // a full disk only shows once the buffers are flushed
+    bool ok = closeLevels();
+    ok = !ferror(fp) && ok;
+    ok = fclose(fp) == 0 && ok;
+    return ok ? 1 : 0;
+}
+
+size_t FileWriter::EncodeBMP(std::string &image, const unsigned char *data, int width, int height) {
+    const Pixel *pixels = reinterpret_cast<const Pixel *>(data);
+    unsigned char header[HEADER_SIZE];
+    encodeHeader(header, width, height);
+    image.clear();
+    image.reserve(HEADER_SIZE + (3 * (size_t)width + 3) / 4 * 4 * height);
+    image.append(reinterpret_cast<const char *>(header), HEADER_SIZE);
+    for (int i = 0; i < height; i++) {
+        encodeRow(pixels + (size_t)i * width, width);
+        image.append(reinterpret_cast<const char *>(encoded.data()), encoded.size());
+    }
+    return image.size();
 }
@@ -1,13 +1,45 @@
 #if !defined(FILEWRITER_H)
 #define FILEWRITER_H
+#include <cstdio>
 #include <string>
+#include <vector>
+#include "Pixel.h"
 extern bool verbose;
 class FileWriter {
 private:
+    static const int HEADER_SIZE = 54;
+
+    // one level of the thumbnail pyramid, streamed to its own file
+    struct MipLevel {
+        FILE *fp;
+        std::string filename;
+        int width;
+        int height;
+        int rowsWritten;
+        int pendingRows;          // rows of the parent level waiting to be filtered
+        std::vector<Pixel> band;  // two rows of the parent level
+        std::vector<Pixel> row;   // the filtered row
+    };
+    int mipmapMinSize = 0; // 0: no pyramid
+    std::vector<MipLevel> levels;
+    std::vector<unsigned char> encoded; // the last row encoded
+
+    void encodeHeader(unsigned char *header, int width, int height);
+    void encodeRow(const Pixel *row, int width);
+    void writeHeader(FILE *fp, int width, int height);
+    void writeRow(FILE *fp, const Pixel *row, int width);
+    void pushRow(size_t level, const Pixel *row); // the parent row is 2 * width of the level wide
+    bool openLevels(std::string filename, int width, int height);
+    bool closeLevels();
+
 public:
     FileWriter();
     ~FileWriter();
+    void setMipmap(int minSize) { mipmapMinSize = minSize; }
     size_t WriteBMP(std::string filename, const unsigned char *data, int width, int height);
+    // the file WriteBMP would write, into image, without the pyramid; its size
+    size_t EncodeBMP(std::string &image, const unsigned char *data, int width, int height);
+    static void downsampleRow(const Pixel *row0, const Pixel *row1, Pixel *out, int outWidth);
 };
 
 #endif // FILEWRITER_H
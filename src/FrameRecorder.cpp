@@ -0,0 +1,73 @@
+#include "FrameRecorder.h"
+#include "Pixel.h"
+FrameRecorder::FrameRecorder() {
+}
+
+FrameRecorder::~FrameRecorder() {
+    close();
+}
+
+void FrameRecorder::writeInt(int value) {
+    unsigned char bytes[4];
+    bytes[0] = (unsigned char)(value);
+    bytes[1] = (unsigned char)(value >> 8);
+    bytes[2] = (unsigned char)(value >> 16);
+    bytes[3] = (unsigned char)(value >> 24);
+    fwrite(bytes, 1, 4, fp);
+}
+
+bool FrameRecorder::open(std::string filename, int width, int height) {
+    close();
+    fp = fopen(filename.c_str(), "wb");
+    if (!fp) {
+        return false;
+    }
+    this->width = width;
+    this->height = height;
+    frames = 0;
+    fwrite("LOGOFRM1", 1, 8, fp);
+    writeInt(width);
+    writeInt(height);
+    return true;
+}
+
+// [x0, x1] and [y0, y1] are inclusive, already clipped to the canvas
+void FrameRecorder::writeFrame(const unsigned char *data, int x0, int y0, int x1, int y1) {
+    if (!fp) {
+        return;
+    }
+    int w = 0;
+    int h = 0;
+    if (x0 <= x1 && y0 <= y1) {
+        w = x1 - x0 + 1;
+        h = y1 - y0 + 1;
+    } else {
+        // nothing changed, keep an empty frame so timing is preserved
+        x0 = y0 = 0;
+    }
+    writeInt(x0);
+    writeInt(y0);
+    writeInt(w);
+    writeInt(h);
+
+    const Pixel *pixels = reinterpret_cast<const Pixel *>(data);
+    unsigned char *row = new unsigned char[3 * (w > 0 ? w : 1)];
+    for (int y = y0; y < y0 + h; y++) {
+        const Pixel *p = pixels + y * width + x0;
+        for (int i = 0; i < w; i++) {
+            row[3 * i + 0] = p[i].r;
+            row[3 * i + 1] = p[i].g;
+            row[3 * i + 2] = p[i].b;
+        }
+        fwrite(row, 3, w, fp);
+    }
+    delete[] row;
+    frames++;
+}
+
+void FrameRecorder::close() {
+    if (fp) {
+        fclose(fp);
+        fp = nullptr;
+    }
+}
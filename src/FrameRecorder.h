@@ -0,0 +1,32 @@
+#if !defined(FRAMERECORDER_H)
+#define FRAMERECORDER_H
+
+#include <cstdio>
+#include <string>
+
+// Writes an animation as a raw frame sequence.
+// Every frame only stores the dirty rectangle relative to the previous frame,
+// so a frame costs as much as the pixels that changed.
+//
+// File layout (all integers are 32-bit little endian):
+//   "LOGOFRM1" width height
+//   per frame: x y w h, then w*h RGB triples, bottom row first
+// The first frame always covers the whole canvas.
+class FrameRecorder {
+private:
+    FILE *fp = nullptr;
+    int width = 0;
+    int height = 0;
+    int frames = 0;
+    void writeInt(int value);
+
+public:
+    FrameRecorder();
+    ~FrameRecorder();
+    bool open(std::string filename, int width, int height);
+    void writeFrame(const unsigned char *data, int x0, int y0, int x1, int y1);
+    void close();
+    int getFrameCount() const { return frames; }
+};
+
+#endif // FRAMERECORDER_H
@@ -1,7 +1,25 @@
 #include "Function.h"
 #include "VariableWrapper.h"
+#include "Op.h"
+#include "LoopKernel.h"
 Function::Function(std::string name, std::vector<VariableWrapper> paraList) : _name(name), paraList(paraList) {
 }
 
 Function::~Function() {
+    for (size_t i = 0; i < _ops.size(); i++)
+        delete _ops[i];
+    delete kernel;
+}
+
+// the most variables a frame of this function can hold: its parameters and
+// every DEF in the body (inlined bodies included, which only over-counts)
+size_t Function::getFrameSize() {
+    if (frameSize < 0) {
+        frameSize = paraList.size();
+        for (auto op : _ops) {
+            if (op->isDefOp())
+                frameSize++;
+        }
+    }
+    return frameSize;
 }
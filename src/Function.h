@@ -6,12 +6,18 @@
 #include <vector>
 #include "VariableWrapper.h"
 class Op;
+class LoopKernel;
 class Function {
+    friend class Jit;
+
 private:
     std::string _name;
     int _argc;
     std::vector<Op *> _ops; // A function is made up of a group of Ops
     std::vector<VariableWrapper> paraList;
+    int frameSize = -1; // computed on the first call, the ops are final by then
+    LoopKernel *kernel = nullptr; // the whole body, built by the Jit once the function is hot
+    bool kernelTried = false;
 public:
     Function(std::string name, std::vector<VariableWrapper> paraList);
     ~Function();
@@ -24,6 +30,7 @@ public:
     std::vector<VariableWrapper>& getParaList(){
         return paraList;
     }
+    size_t getFrameSize();
     // static Function &getFunctionByName(std::string name);
 };
 
@@ -1,10 +1,19 @@
 #include "Interpreter.h"
+#include "Bytecode.h"
+#include "CppEmitter.h"
 #include "Function.h"
+#include "Optimizer.h"
+#include "Program.h"
+#include "StampCache.h"
+#include "Verifier.h"
 #include "Variable.h"
 #include "symbols.h"
 #include "utility.h"
+#include <new>
 #include <sstream>
-Interpreter::Interpreter() {
+#include <stdexcept>
+#include <thread>
+Interpreter::Interpreter() : symbols(std::make_shared<SymbolTable>()), error("") {
 }
 
 Interpreter::~Interpreter() {
@@ -14,19 +23,165 @@ int assertSymbolType(Symbol &s, SymbolType type) {
     if (s.getType() == type) {
         return 0;
     }
-    std::cerr << "Unexpected symbol at line " << s.getLineno() << ": [type=" << getSymbolTypeName(s.getType()) << ", name=\'" << s.getName() << "\', value=" << s.getValue() << "]" << std::endl;
-    exit(1);
-    return -1;
+    std::ostringstream message;
+    message << "Unexpected symbol at line " << s.getLineno() << ": [type=" << getSymbolTypeName(s.getType()) << ", name=\'" << s.getName() << "\', value=" << s.getValue() << "]";
+    throw LogoError(message.str());
 }
-void Interpreter::compile(const char *filename, const char *outName) {
+
+bool Interpreter::compile(const char *filename, const char *outName) {
+    return load(filename, outName) && render() && encode();
+}
+
+bool Interpreter::load(const char *filename, const char *outName) {
+    return stage([&] {
+        readFile(filename);
+        configure(filename, outName);
+    });
+}
+
+bool Interpreter::loadSource(const std::string &source, const char *outName) {
+    return stage([&] {
+        readProgram(openSource(source));
+        configure("", outName);
+    });
+}
+
+bool Interpreter::load(const Program &program, const char *outName) {
+    symbols = program.parsed.symbols;
+    return stage([&] {
+        const Interpreter &text = program.parsed;
+        autoSize = text.autoSize;
+        autoSizeLine = text.autoSizeLine;
+        width = text.width;
+        height = text.height;
+        backgroundR = text.backgroundR;
+        backgroundG = text.backgroundG;
+        backgroundB = text.backgroundB;
+        startX = text.startX;
+        startY = text.startY;
+        parameters = text.parameters;
+        program.copyTo(executor, options.values);
+        configure(program.name.c_str(), outName);
+    });
+}
+
+FILE *Interpreter::openFile(const char *filename) {
     FILE *fp = fopen(filename, "r");
     if (fp == nullptr) {
-        std::cout << "Cannot open the file" << std::endl;
-        return;
+        throw LogoError("Cannot open the file", true);
+    }
+    return fp;
+}
+
+void Interpreter::readFile(const char *filename) {
+    if (Bytecode::isBytecode(filename)) {
+        Bytecode bytecode(this);
+        bytecode.read(filename);
+    } else {
+        readProgram(openFile(filename));
     }
-    extern FILE *yyin;
+}
+
+FILE *Interpreter::openSource(const std::string &source) {
+    if (source.empty()) {
+        issueError("The file is empty");
+    }
+#if defined(__unix__) || defined(__APPLE__)
+    FILE *fp = fmemopen(const_cast<char *>(source.data()), source.size(), "r");
+#else
+    FILE *fp = tmpfile();
+    if (fp != nullptr) {
+        fwrite(source.data(), 1, source.size(), fp);
+        rewind(fp);
+    }
+#endif
+    if (fp == nullptr) {
+        issueError("cannot read the program");
+    }
+    return fp;
+}
+
+bool Interpreter::render() {
+    return stage([this] {
+        if (prepare())
+            executor.run();
+        finishRun();
+    });
+}
+
+bool Interpreter::renderSlice(long maxOps, unsigned long long maxPixels, bool &more) {
+    more = false;
+    return stage([&] {
+        if (!prepared) {
+            prepared = true;
+            if (!prepare())
+                return;
+        } else if (written) {
+            return;
+        }
+        more = executor.step(maxOps, maxPixels);
+        if (!more)
+            finishRun();
+    });
+}
+
+bool Interpreter::encode() {
+    return stage([this] { write(); });
+}
+
+bool Interpreter::encodeTo(std::string &image) {
+    return stage([&] {
+        if (written)
+            return;
+        written = true;
+        executor.encodeImage(image);
+    });
+}
+
+// run one stage with the names of this program, keeping the error that stops
+// it; running out of memory is an error of the program too, so a batch or the
+// server goes on
+bool Interpreter::stage(const std::function<void()> &step) {
+    SymbolTable::Scope scope(*symbols);
+    try {
+        step();
+    } catch (const LogoError &e) {
+        error = e;
+        return false;
+    } catch (const std::bad_alloc &) {
+        error = LogoError("Error: out of memory");
+        return false;
+    } catch (const std::exception &e) {
+        error = LogoError(std::string("Error: ") + e.what());
+        return false;
+    }
+    return true;
+}
+
+// read the symbols of the file into lexQueue, leaving the scanner of this thread ready for the next file
+void Interpreter::scan(FILE *fp) {
     yyin = fp;
-    yylex();
+    yylineno = 1;
+    scanQueue = &lexQueue;
+    try {
+        yylex();
+    } catch (...) {
+        yylex_destroy();
+        scanQueue = nullptr;
+        throw;
+    }
+    yylex_destroy();
+    scanQueue = nullptr;
+    executor.lastLine = yylineno;
+}
+
+void Interpreter::readProgram(FILE *fp) {
+    try {
+        scan(fp);
+    } catch (...) {
+        fclose(fp);
+        throw;
+    }
     fclose(fp);
 
     // std::cout << "symbol queue size: " << lexQueue.size() << std::endl;
@@ -36,27 +191,26 @@ void Interpreter::compile(const char *filename, const char *outName) {
     // header
     assertSymbolType(lexQueue.front(), ATSIZE);
     lexQueue.pop(); // @SIZE
-    int width, height;
-    width = nextInt();
-    height = nextInt();
-    executor.initNewBuffer(width, height);
+    // @SIZE AUTO: size the canvas to the drawing, found by a dry run
+    autoSize = !lexQueue.empty() && lexQueue.front().getType() == IDENTIFIER && lexQueue.front().getName() == "AUTO";
+    if (autoSize) {
+        autoSizeLine = lexQueue.front().getLineno();
+        lexQueue.pop();
+    } else {
+        width = nextInt();
+        height = nextInt();
+    }
 
     assertSymbolType(lexQueue.front(), ATBACKGROUND);
     lexQueue.pop(); // @BACKGROUND
-    int r;
-    int g;
-    int b;
-    r = nextInt();
-    g = nextInt();
-    b = nextInt();
-    executor.setBackground(r, g, b);
+    backgroundR = nextInt();
+    backgroundG = nextInt();
+    backgroundB = nextInt();
 
     assertSymbolType(lexQueue.front(), ATPOSITION);
     lexQueue.pop(); // @POSITION
-    int x, y;
-    x = nextInt();
-    y = nextInt();
-    executor.setPenPosition(x, y);
+    startX = nextInt();
+    startY = nextInt();
 
     // body
     while (!lexQueue.empty()) {
@@ -66,21 +220,186 @@ void Interpreter::compile(const char *filename, const char *outName) {
     if (executor.current_function->getName() != "0global") {
         issueError("End of file in function definition, did you miss \"END FUNC\" for " + executor.current_function->getName() + "()?");
     }
-    executor.run();
-    std::string outFileName;
+    // every error the program text can cause is reported here, before anything runs
+    Verifier verifier(&executor);
+    std::string report;
+    if (!verifier.verify(report))
+        throw LogoError(report);
+}
+
+void Interpreter::configure(const char *filename, const char *outName) {
+    for (auto it = options.values.begin(); it != options.values.end(); it++) {
+        if (!parameters.count(it->first)) {
+            issueError("--set " + it->first + ": the program has no DEF " + it->first + " outside of its functions");
+        }
+    }
+    if (options.size) {
+        autoSize = false;
+        width = options.width;
+        height = options.height;
+    }
+    if (options.background) {
+        backgroundR = options.backgroundR;
+        backgroundG = options.backgroundG;
+        backgroundB = options.backgroundB;
+    }
+    if (options.position) {
+        startX = options.positionX;
+        startY = options.positionY;
+    }
+    if (!options.emitBytecode.empty()) {
+        if (!options.emitCpp.empty() || options.dryRun || options.estimate) {
+            issueError("--emit-bytecode cannot be used with --emit-cpp, --dry-run or --estimate");
+        }
+        outFileName = options.emitBytecode;
+        return; // prepare() writes the program as it is now, nothing is rendered
+    }
+    if (options.svg) {
+        if (options.viewport) {
+            issueError("--viewport cannot be used with --svg");
+        }
+        executor.startVectorOutput();
+    }
+    if (!options.emitCpp.empty()) {
+        if (options.svg || options.dryRun || options.mipmapMinSize > 0 || options.frameEveryOps > 0 || options.frameEveryPixels > 0) {
+            issueError("--emit-cpp cannot be used with --svg, --dry-run, --mipmap or animation export");
+        }
+    }
+    if (options.viewport) {
+        if (options.viewportW <= 0 || options.viewportH <= 0) {
+            issueError("viewport size should be positive");
+        }
+        executor.setViewport(options.viewportX, options.viewportY, options.viewportW, options.viewportH);
+    }
+    if (autoSize && (options.viewport || options.svg)) {
+        issueError("@SIZE AUTO cannot be used with --viewport or --svg", autoSizeLine);
+    }
+    if (autoSize || options.dryRun) {
+        executor.startDryRun();
+    }
+    executor.setLimits(options.maxCanvasBytes, options.maxOps, options.maxPixels, options.maxCallDepth, options.timeLimitMs);
+    executor.initNewBuffer(width, height);
+    executor.setBackground(backgroundR, backgroundG, backgroundB);
+    executor.setPenPosition(startX, startY);
+
+    if (options.estimate) {
+        CostEstimator estimator(&executor);
+        cost = estimator.run(autoSize, options.svg);
+    }
+    if (options.optimize) {
+        Optimizer optimizer(&executor);
+        optimizer.optimize();
+        if (options.jit && !executor.startJit(options.perfMap) && verbose)
+            std::cout << "jit: not supported on this platform" << std::endl;
+    }
+    if (options.cull)
+        executor.startCulling();
+    if (options.stampCacheBytes)
+        executor.startStampCache(options.stampCacheBytes);
+    int threads = options.threads ? options.threads : std::thread::hardware_concurrency();
+    if ((options.optimize && threads > 1) || options.frontToBack)
+        executor.startBands(std::max(threads, 1), options.frontToBack);
+
     if (outName) {
         outFileName = outName;
+    } else if (!options.outName.empty()) {
+        outFileName = options.outName;
     } else {
         std::string inputName(filename);
         // remove the last ".bmp", if there is one
+        std::string extension = options.svg ? ".svg" : ".bmp";
         if (ends_with(inputName, ".logo") || ends_with(inputName, ".LOGO")) {
-            outFileName = std::string(inputName.begin(), inputName.end() - 5) + ".bmp";
+            outFileName = std::string(inputName.begin(), inputName.end() - 5) + extension;
+        } else if (ends_with(inputName, ".logoc")) {
+            outFileName = std::string(inputName.begin(), inputName.end() - 6) + extension;
         } else {
-            outFileName = inputName + ".bmp";
+            outFileName = inputName + extension;
         }
     }
+}
+
+// everything before the rendering runs: a dry run, @SIZE AUTO, C++ emission
+// and animation export; false when there is nothing left to render
+bool Interpreter::prepare() {
+    if (!options.emitBytecode.empty()) {
+        Bytecode bytecode(this);
+        if (!bytecode.write(options.emitBytecode)) {
+            issueError("cannot write to file " + options.emitBytecode);
+        }
+        if (!options.quiet)
+            std::cout << "write to file " << options.emitBytecode << std::endl;
+        written = true;
+        return false;
+    }
+    if (options.estimate) {
+        cost.print(std::cout);
+        written = true;
+        return false;
+    }
+    if (options.dryRun) {
+        executor.run();
+        executor.printDryRunReport();
+        written = true;
+        return false;
+    }
+    if (autoSize) {
+        executor.run();
+        int x0, y0, x1, y1;
+        if (!executor.getDrawnBox(x0, y0, x1, y1)) {
+            // nothing is drawn, keep a single background pixel at the start position
+            x0 = x1 = startX;
+            y0 = y1 = startY;
+        }
+        if (verbose)
+            std::cout << "@SIZE AUTO: " << x1 - x0 + 1 << "x" << y1 - y0 + 1 << std::endl;
+        executor.restart();
+        // equivalent to @SIZE w h with @POSITION shifted by [-x0, -y0], but the
+        // turtle keeps its coordinates so every pixel lands exactly where the dry run saw it
+        executor.initBufferAt(x0, y0, x1 - x0 + 1, y1 - y0 + 1);
+    }
+
+    if (!options.emitCpp.empty()) {
+        CppEmitter emitter(&executor);
+        if (!emitter.write(options.emitCpp, outFileName)) {
+            issueError("cannot write to file " + options.emitCpp);
+        }
+        std::cout << "write to file " << options.emitCpp << std::endl;
+        written = true;
+        return false;
+    }
 
-    executor.writeFile(outFileName);
+    if (options.frameEveryOps > 0 || options.frameEveryPixels > 0) {
+        if (options.svg) {
+            issueError("animation export needs a raster canvas, it cannot be used with --svg");
+        }
+        std::string framesName = options.framesName;
+        if (framesName.empty()) {
+            if (ends_with(outFileName, ".bmp") || ends_with(outFileName, ".BMP")) {
+                framesName = std::string(outFileName.begin(), outFileName.end() - 4) + ".frames";
+            } else {
+                framesName = outFileName + ".frames";
+            }
+        }
+        if (!executor.startAnimation(framesName, options.frameEveryOps, options.frameEveryPixels)) {
+            issueError("cannot write to file " + framesName);
+        }
+    }
+    return true;
+}
+
+void Interpreter::finishRun() {
+    if (executor.stamps && !options.quiet && !written)
+        executor.stamps->printStatistics();
+}
+
+void Interpreter::write() {
+    if (written)
+        return;
+    written = true;
+    if (!executor.writeFile(outFileName, options.mipmapMinSize))
+        throw LogoError("cannot write to file " + outFileName);
+    if (!options.quiet)
+        std::cout << "write to file " << outFileName << std::endl;
 }
 
 int Interpreter::nextInt() {
@@ -193,6 +512,13 @@ void Interpreter::processSymbol(Symbol &symbol) {
         auto varName = nextSymbol();
         assertSymbolType(varName, IDENTIFIER);
         int init_value = nextInt();
+        // a DEF outside of the functions is a parameter of the program, --set may change it
+        if (executor.current_function == executor.allFunctions[0]) {
+            parameters.insert(varName.getName());
+            auto value = options.values.find(varName.getName());
+            if (value != options.values.end())
+                init_value = value->second;
+        }
         executor.def(varName.getName(), init_value, symbol.getLineno());
     } else {
         std::string msg = "Unexpected symbol: " + symbol.getName();
@@ -239,11 +565,10 @@ std::vector<VariableWrapper> Interpreter::getIdentifierList() {
 
 void Interpreter::issueError(std::string err, int lineno) {
     if (lineno == -1) {
-        std::cerr << "Error: " << err << std::endl;
+        throw LogoError("Error: " + err);
     } else {
-        std::cerr << "Error at line " << lineno << ": " << err << std::endl;
+        throw LogoError("Error at line " + std::to_string(lineno) + ": " + err);
     }
-    exit(1);
 }
 
 void Interpreter::issueWarning(std::string err, int lineno) {
@@ -1,17 +1,55 @@
 #if !defined(INTERPRETER_H)
 #define INTERPRETER_H
 
+#include "CostEstimator.h"
 #include "Executor.h"
+#include "Options.h"
 #include "symbols.h"
+#include "utility.h"
 #include <fstream>
+#include <functional>
 #include <iostream>
+#include <memory>
 #include <queue>
+#include <set>
 #include <string>
 extern bool verbose;
+class Program;
 class Interpreter {
+    friend class Program;
+    friend class Bytecode;
+
 private:
-    // std::queue<std::string> lexQueue;
+    std::queue<Symbol> lexQueue; // symbols of the file, consumed while parsing
+    // the names of the program, current while a stage runs; shared with the Program it was loaded from
+    std::shared_ptr<SymbolTable> symbols;
     Executor executor;
+    Options options;
+    LogoError error;
+    // the header, as the program text or the options set it
+    bool autoSize = false;
+    int autoSizeLine = -1;
+    int width = 0, height = 0;
+    int backgroundR = 0, backgroundG = 0, backgroundB = 0;
+    int startX = 0, startY = 0;
+    std::set<std::string> parameters; // names of the DEFs outside of the functions, see Options::values
+    std::string outFileName;
+    bool written = false; // nothing is left for encode()
+    bool prepared = false; // renderSlice() has started
+    CostEstimate cost;     // with Options::estimate
+    bool stage(const std::function<void()> &step);
+    FILE *openFile(const char *filename);
+    FILE *openSource(const std::string &source);
+    // readProgram() for the file, which may hold the program as text or as bytecode
+    void readFile(const char *filename);
+    void scan(FILE *fp);
+    // parse and check the program, which only depends on its text
+    void readProgram(FILE *fp);
+    // set the executor up for the render that Options asks for
+    void configure(const char *filename, const char *outName);
+    bool prepare();
+    void finishRun();
+    void write();
     int nextInt();
     VariableWrapper getNextVariableWrapper();
     Symbol nextSymbol();
@@ -22,7 +60,32 @@ private:
 public:
     Interpreter();
     ~Interpreter();
-    void compile(const char *filename, const char *outName = nullptr);
+    void setOptions(const Options &options) { this->options = options; }
+    // parse, check and run the program and write the image; false on an
+    // error, which is then in getError() and has not been reported yet
+    bool compile(const char *filename, const char *outName = nullptr);
+    // the stages of compile(), each false on an error: parse and check the
+    // program, then run it, then write the image
+    bool load(const char *filename, const char *outName = nullptr);
+    // load() for a program held in memory, which has no name to derive the output from
+    bool loadSource(const std::string &source, const char *outName);
+    // load() for a program compiled before, into an Interpreter that has not
+    // loaded one yet; the program may be loaded by any number of them at once
+    bool load(const Program &program, const char *outName = nullptr);
+    bool render();
+    // render() a slice at a time, see Executor::step; more is set while the
+    // program has not finished, a call with more unset is followed by encode()
+    bool renderSlice(long maxOps, unsigned long long maxPixels, bool &more);
+    bool encode();
+    // encode() into image instead of the output file, as writeFile would write
+    // it but without --mipmap thumbnails; nothing is written
+    bool encodeTo(std::string &image);
+    // take the pixel buffer from the pool and give it back when destroyed
+    void setBufferPool(BufferPool *pool) { executor.bufferPool = pool; }
+    const LogoError &getError() const { return error; }
+    const std::string &getOutputName() const { return outFileName; }
+    // set by load() with Options::estimate, which then runs nothing
+    const CostEstimate &getCostEstimate() const { return cost; }
     void issueError(std::string err,int lineno = -1);
     void issueWarning(std::string err,int lineno = -1);
 };
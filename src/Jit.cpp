@@ -0,0 +1,262 @@
+#include "Jit.h"
+#include "Executor.h"
+#include "Function.h"
+#include "LoopKernel.h"
+#include "Optimizer.h"
+#include "Op.h"
+#include <cstring>
+#if defined(__x86_64__) && defined(__linux__)
+#include <sys/mman.h>
+#include <unistd.h>
+#define JIT_X86_64
+#endif
+
+// helpers called from the generated code, SysV calling convention
+void Jit::jitMove(Executor *executor, int steps) {
+    executor->moveTurtle(steps);
+}
+
+void Jit::jitTurn(Executor *executor, int degrees) {
+    executor->turnTurtle(degrees);
+}
+
+void Jit::jitColor(Executor *executor, int r, int g, int b) {
+    executor->setPenColorValue(r, g, b);
+}
+
+void Jit::jitCloak(Executor *executor) {
+    executor->clocked = true;
+}
+
+void Jit::jitPenWidth(Executor *executor, int w) {
+    executor->setPenWidthValue(w);
+}
+
+void Jit::jitPixelRun(Executor *executor, const void *colors, size_t count) {
+    executor->drawPixelRun(static_cast<const Pixel *>(colors), count);
+}
+
+namespace {
+
+// just the x86-64 instructions a kernel needs
+class Assembler {
+public:
+    std::vector<unsigned char> code;
+
+    void byte(unsigned char b) { code.push_back(b); }
+    void bytes(std::initializer_list<unsigned char> list) { code.insert(code.end(), list); }
+    void imm32(int v) {
+        for (int i = 0; i < 4; i++)
+            byte((unsigned char)(v >> (8 * i)));
+    }
+    void imm64(const void *p) {
+        unsigned long long v = reinterpret_cast<unsigned long long>(p);
+        for (int i = 0; i < 8; i++)
+            byte((unsigned char)(v >> (8 * i)));
+    }
+    size_t here() const { return code.size(); }
+    // patch the rel32 that ends at [end] to jump to [target]
+    void patch(size_t end, size_t target) {
+        int rel = (int)target - (int)end;
+        for (int i = 0; i < 4; i++)
+            code[end - 4 + i] = (unsigned char)(rel >> (8 * i));
+    }
+
+    // registers for the 32-bit arguments, in modrm encoding
+    enum Reg32 { ECX = 1, EDX = 2, ESI = 6 };
+
+    // reg = value of operand, operands are literals or indexes into the r12 array of int *
+    void loadOperand(Reg32 reg, const LoopKernel::Operand &operand) {
+        if (!operand.isSlot) {
+            byte(0xB8 + reg); // mov reg, imm32
+            imm32(operand.value);
+            return;
+        }
+        bytes({0x49, 0x8B, 0x84, 0x24}); // mov rax, [r12 + disp32]
+        imm32(operand.value * 8);
+        bytes({0x8B, (unsigned char)(reg << 3)}); // mov reg, [rax]
+    }
+    void callHelper(const void *helper) {
+        bytes({0x48, 0x89, 0xDF}); // mov rdi, rbx
+        bytes({0x48, 0xB8});       // mov rax, imm64
+        imm64(helper);
+        bytes({0xFF, 0xD0}); // call rax
+    }
+};
+
+} // namespace
+
+Jit::Jit() {
+}
+
+Jit::~Jit() {
+#if defined(JIT_X86_64)
+    for (size_t i = 0; i < regions.size(); i++)
+        munmap(regions[i].start, regions[i].size);
+#endif
+    if (perfMap)
+        fclose(perfMap);
+}
+
+bool Jit::isSupported() {
+#if defined(JIT_X86_64)
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool Jit::openPerfMap() {
+#if defined(JIT_X86_64)
+    std::string name = "/tmp/perf-" + std::to_string(getpid()) + ".map";
+    perfMap = fopen(name.c_str(), "w");
+#endif
+    return perfMap != nullptr;
+}
+
+// Register use of the generated function void(Executor *, int **values, int loops):
+// rbx the executor, r12 the values of the slots, r13d the iterations left;
+// the counter of the loop at nesting depth d is the dword at [rsp + 8 * d].
+bool Jit::compile(LoopKernel *kernel, const std::string &name) {
+    if (kernel->jitTried)
+        return kernel->native != nullptr;
+    kernel->jitTried = true;
+#if defined(JIT_X86_64)
+    const std::vector<LoopKernel::Step> &steps = kernel->steps;
+    int depth = 0;
+    int maxDepth = 0;
+    for (size_t i = 0; i < steps.size(); i++) {
+        // a bad pen width throws, and exceptions cannot unwind through generated code
+        if (steps[i].kind == LoopKernel::K_PENWIDTH && steps[i].arg[0].isSlot)
+            return false;
+        if (steps[i].kind == LoopKernel::K_LOOP)
+            maxDepth = std::max(maxDepth, ++depth);
+        else if (steps[i].kind == LoopKernel::K_ENDLOOP)
+            depth--;
+    }
+    // 4 pushes leave rsp 8 bytes off the 16 byte call alignment
+    int frameSize = 8 * maxDepth;
+    if (frameSize % 16 != 8)
+        frameSize += 8;
+
+    Assembler a;
+    a.bytes({0x53, 0x41, 0x54, 0x41, 0x55, 0x41, 0x56}); // push rbx, r12, r13, r14
+    a.bytes({0x48, 0x81, 0xEC});                         // sub rsp, imm32
+    a.imm32(frameSize);
+    a.bytes({0x48, 0x89, 0xFB}); // mov rbx, rdi
+    a.bytes({0x49, 0x89, 0xF4}); // mov r12, rsi
+    a.bytes({0x41, 0x89, 0xD5}); // mov r13d, edx
+    a.bytes({0x45, 0x85, 0xED}); // test r13d, r13d
+    a.bytes({0x0F, 0x8E});       // jle done
+    a.imm32(0);
+    size_t toDone = a.here();
+    size_t top = a.here();
+
+    std::vector<size_t> loopTops;
+    for (size_t i = 0; i < steps.size(); i++) {
+        const LoopKernel::Step &step = steps[i];
+        switch (step.kind) {
+        case LoopKernel::K_MOVE:
+            a.loadOperand(Assembler::ESI, step.arg[0]);
+            a.callHelper(reinterpret_cast<const void *>(&Jit::jitMove));
+            break;
+        case LoopKernel::K_TURN:
+            a.loadOperand(Assembler::ESI, step.arg[0]);
+            a.callHelper(reinterpret_cast<const void *>(&Jit::jitTurn));
+            break;
+        case LoopKernel::K_COLOR:
+            a.loadOperand(Assembler::ESI, step.arg[0]);
+            a.loadOperand(Assembler::EDX, step.arg[1]);
+            a.loadOperand(Assembler::ECX, step.arg[2]);
+            a.callHelper(reinterpret_cast<const void *>(&Jit::jitColor));
+            break;
+        case LoopKernel::K_CLOAK:
+            a.callHelper(reinterpret_cast<const void *>(&Jit::jitCloak));
+            break;
+        case LoopKernel::K_PENWIDTH:
+            a.loadOperand(Assembler::ESI, step.arg[0]);
+            a.callHelper(reinterpret_cast<const void *>(&Jit::jitPenWidth));
+            break;
+        case LoopKernel::K_ADD:
+            a.loadOperand(Assembler::ECX, step.arg[1]);
+            a.bytes({0x49, 0x8B, 0x84, 0x24}); // mov rax, [r12 + disp32]
+            a.imm32(step.arg[0].value * 8);
+            a.bytes({0x01, 0x08}); // add [rax], ecx
+            break;
+        case LoopKernel::K_PIXELRUN:
+            a.bytes({0x48, 0xBE}); // mov rsi, imm64
+            a.imm64(step.run->getColors().data());
+            a.bytes({0x48, 0xBA}); // mov rdx, imm64
+            a.imm64(reinterpret_cast<const void *>(step.run->size()));
+            a.callHelper(reinterpret_cast<const void *>(&Jit::jitPixelRun));
+            break;
+        case LoopKernel::K_LOOP:
+            if (step.arg[0].value == 0) {
+                // the body never runs
+                i = step.target;
+                break;
+            }
+            a.bytes({0xC7, 0x84, 0x24}); // mov dword [rsp + disp32], imm32
+            a.imm32(8 * loopTops.size());
+            a.imm32(step.arg[0].value);
+            loopTops.push_back(a.here());
+            break;
+        case LoopKernel::K_ENDLOOP: {
+            size_t loopTop = loopTops.back();
+            loopTops.pop_back();
+            a.bytes({0xFF, 0x8C, 0x24}); // dec dword [rsp + disp32]
+            a.imm32(8 * loopTops.size());
+            a.bytes({0x0F, 0x85}); // jnz loopTop
+            a.imm32(0);
+            a.patch(a.here(), loopTop);
+            break;
+        }
+        }
+    }
+    a.bytes({0x41, 0xFF, 0xCD}); // dec r13d
+    a.bytes({0x0F, 0x85});       // jnz top
+    a.imm32(0);
+    a.patch(a.here(), top);
+    a.patch(toDone, a.here());
+    a.bytes({0x48, 0x81, 0xC4}); // add rsp, imm32
+    a.imm32(frameSize);
+    a.bytes({0x41, 0x5E, 0x41, 0x5D, 0x41, 0x5C, 0x5B, 0xC3}); // pop r14, r13, r12, rbx; ret
+
+    // written while writable, then flipped to executable
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t size = (a.code.size() + page - 1) / page * page;
+    void *memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED)
+        return false;
+    memcpy(memory, a.code.data(), a.code.size());
+    if (mprotect(memory, size, PROT_READ | PROT_EXEC) != 0) {
+        munmap(memory, size);
+        return false;
+    }
+    Region region = {memory, size};
+    regions.push_back(region);
+    kernel->native = reinterpret_cast<LoopKernel::NativeCode>(memory);
+    compiled++;
+    if (perfMap) {
+        fprintf(perfMap, "%lx %zx logo::%s\n", reinterpret_cast<unsigned long>(memory), a.code.size(), name.c_str());
+        fflush(perfMap);
+    }
+    if (verbose)
+        std::cout << "jit: compiled " << name << ", " << a.code.size() << " bytes" << std::endl;
+    return true;
+#else
+    (void)name;
+    return false;
+#endif
+}
+
+LoopKernel *Jit::functionKernel(Function *function) {
+    if (!function->kernelTried) {
+        function->kernelTried = true;
+        std::vector<Op *> &ops = *function->getOps();
+        function->kernel = Optimizer::compileLoopKernel(ops, 0, ops.size());
+        if (function->kernel)
+            compile(function->kernel, "func " + function->getName());
+    }
+    return function->kernel;
+}
@@ -0,0 +1,57 @@
+#if !defined(JIT_H)
+#define JIT_H
+
+#include <cstddef>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+class Executor;
+class Function;
+class LoopKernel;
+
+// Translates hot LoopKernels into x86-64 machine code at run time.
+// StartLoopOp counts the iterations it runs and CallOp the calls it makes;
+// past a threshold the loop body, or the whole body of the called Function,
+// is compiled: operands are loaded straight from the bound variables, loop
+// counters live in the native stack frame, and every drawing step is a call
+// into the Executor's rasterizer. Anything that cannot be compiled, on any
+// other platform, or when mapping executable memory fails, keeps running in
+// the kernel interpreter (LoopKernel::run), which keeps the interpreter as
+// the fallback for everything else.
+class Jit {
+public:
+    // compile a loop after this many iterations, a function after this many calls
+    static const long HOT_LOOP_ITERATIONS = 64;
+    static const long HOT_CALLS = 16;
+
+private:
+    struct Region {
+        void *start;
+        size_t size;
+    };
+    std::vector<Region> regions;
+    FILE *perfMap = nullptr;
+    int compiled = 0;
+
+    static void jitMove(Executor *executor, int steps);
+    static void jitTurn(Executor *executor, int degrees);
+    static void jitColor(Executor *executor, int r, int g, int b);
+    static void jitCloak(Executor *executor);
+    static void jitPenWidth(Executor *executor, int w);
+    static void jitPixelRun(Executor *executor, const void *colors, size_t count);
+
+public:
+    Jit();
+    ~Jit();
+    static bool isSupported();
+    // write /tmp/perf-<pid>.map so perf can name the compiled code
+    bool openPerfMap();
+    // give kernel a native entry point, once; false if it stays interpreted
+    bool compile(LoopKernel *kernel, const std::string &name);
+    // the body of function as a kernel, compiled once, nullptr if the body cannot be
+    LoopKernel *functionKernel(Function *function);
+    int getCompiledCount() const { return compiled; }
+};
+
+#endif // JIT_H
@@ -0,0 +1,118 @@
+#include "LoopKernel.h"
+#include "Executor.h"
+#include "Variable.h"
+
+LoopKernel::LoopKernel() : bodyLength(0) {
+}
+
+LoopKernel::~LoopKernel() {
+}
+
+LoopKernel::Operand LoopKernel::slot(int symbol) {
+    Operand operand;
+    operand.isSlot = true;
+    for (size_t i = 0; i < slotSymbols.size(); i++) {
+        if (slotSymbols[i] == symbol) {
+            operand.value = i;
+            return operand;
+        }
+    }
+    operand.value = slotSymbols.size();
+    slotSymbols.push_back(symbol);
+    return operand;
+}
+
+LoopKernel::Operand LoopKernel::literal(int value) {
+    Operand operand;
+    operand.isSlot = false;
+    operand.value = value;
+    return operand;
+}
+
+void LoopKernel::addStep(StepKind kind, Operand a, Operand b, Operand c, const PixelRunOp *run) {
+    Step step;
+    step.kind = kind;
+    step.arg[0] = a;
+    step.arg[1] = b;
+    step.arg[2] = c;
+    step.target = -1;
+    step.run = run;
+    steps.push_back(step);
+}
+
+// link every K_LOOP with its K_ENDLOOP
+void LoopKernel::finish(size_t bodyLength) {
+    this->bodyLength = bodyLength;
+    std::vector<int> open;
+    for (size_t i = 0; i < steps.size(); i++) {
+        if (steps[i].kind == K_LOOP) {
+            open.push_back(i);
+        } else if (steps[i].kind == K_ENDLOOP) {
+            int start = open.back();
+            open.pop_back();
+            steps[start].target = i;
+            steps[i].target = start;
+        }
+    }
+    vars.resize(slotSymbols.size());
+    values.resize(slotSymbols.size());
+    counters.resize(steps.size());
+}
+
+bool LoopKernel::run(Executor *executor, int loops) const {
+    for (size_t i = 0; i < slotSymbols.size(); i++) {
+        Variable &v = executor->getVariableBySymbol(slotSymbols[i]);
+        if (v == Variable::noVar())
+            return false;
+        vars[i] = &v;
+    }
+    if (native) {
+        for (size_t i = 0; i < vars.size(); i++)
+            values[i] = vars[i]->valuePtr();
+        native(executor, values.data(), loops);
+        return true;
+    }
+#define VALUE(operand) ((operand).isSlot ? vars[(operand).value]->getValue() : (operand).value)
+
+    for (int iteration = 0; iteration < loops; iteration++) {
+        size_t pc = 0;
+        while (pc < steps.size()) {
+            const Step &step = steps[pc];
+            switch (step.kind) {
+            case K_MOVE:
+                executor->moveTurtle(VALUE(step.arg[0]));
+                break;
+            case K_TURN:
+                executor->turnTurtle(VALUE(step.arg[0]));
+                break;
+            case K_COLOR:
+                executor->setPenColorValue(VALUE(step.arg[0]), VALUE(step.arg[1]), VALUE(step.arg[2]));
+                break;
+            case K_CLOAK:
+                executor->clocked = true;
+                break;
+            case K_ADD:
+                vars[step.arg[0].value]->addValue(VALUE(step.arg[1]));
+                break;
+            case K_PENWIDTH:
+                executor->setPenWidthValue(VALUE(step.arg[0]));
+                break;
+            case K_PIXELRUN:
+                executor->drawPixelRun(step.run->getColors().data(), step.run->size());
+                break;
+            case K_LOOP:
+                counters[pc] = step.arg[0].value;
+                if (counters[pc] == 0)
+                    pc = step.target;
+                break;
+            case K_ENDLOOP:
+                if (--counters[step.target] > 0)
+                    pc = step.target;
+                break;
+            }
+            pc++;
+        }
+    }
+#undef VALUE
+    return true;
+}
@@ -0,0 +1,71 @@
+#if !defined(LOOPKERNEL_H)
+#define LOOPKERNEL_H
+
+#include <string>
+#include <vector>
+
+class Executor;
+class PixelRunOp;
+class Variable;
+
+// The body of a LOOP compiled into a flat list of steps by the Optimizer.
+// Only loops whose body moves the turtle, changes the pen, adds to
+// variables or nests such loops are compiled: nothing in them can change
+// which Variable a name refers to, so every name is looked up once per
+// loop entry and the iterations run without op dispatch or name lookups.
+class LoopKernel {
+    friend class Jit;
+
+public:
+    enum StepKind {
+        K_MOVE,
+        K_TURN,
+        K_COLOR,
+        K_CLOAK,
+        K_ADD,
+        K_PENWIDTH,
+        K_PIXELRUN,
+        K_LOOP,   // arg[0]: count, target: index of the matching K_ENDLOOP
+        K_ENDLOOP // target: index of the matching K_LOOP
+    };
+    // an operand is a literal, or the index of a variable slot
+    struct Operand {
+        bool isSlot;
+        int value;
+    };
+    struct Step {
+        StepKind kind;
+        Operand arg[3];
+        int target;
+        const PixelRunOp *run;
+    };
+
+    // machine code for run(), given the executor and the values of the slots
+    typedef void (*NativeCode)(Executor *executor, int **values, int loops);
+
+private:
+    std::vector<Step> steps;
+    std::vector<int> slotSymbols; // interned variable names
+    size_t bodyLength; // number of ops between LOOP and END LOOP
+    NativeCode native = nullptr; // set by the Jit
+    // bound by every run(), sized once by finish() so that a run does not allocate;
+    // a kernel runs on the thread of its Executor and calls nothing, so never twice at once
+    mutable std::vector<Variable *> vars;
+    mutable std::vector<int *> values;
+    mutable std::vector<int> counters; // iterations left for the K_LOOP at each step
+    bool jitTried = false;
+
+public:
+    LoopKernel();
+    ~LoopKernel();
+    Operand slot(int symbol);
+    Operand literal(int value);
+    void addStep(StepKind kind, Operand a = Operand(), Operand b = Operand(), Operand c = Operand(), const PixelRunOp *run = nullptr);
+    void finish(size_t bodyLength);
+    size_t getBodyLength() const { return bodyLength; }
+    // run the whole loop [loops] times, false if a variable is not defined
+    // (then nothing has been executed and the caller interprets the ops)
+    bool run(Executor *executor, int loops) const;
+};
+
+#endif // LOOPKERNEL_H
@@ -2,9 +2,15 @@
 #include "Executor.h"
 // #include "OpsQueue.h"
 #include "Function.h"
+#include "BandRenderer.h"
+#include "CallCuller.h"
+#include "Jit.h"
+#include "LoopKernel.h"
+#include "StampCache.h"
 #include "StackFrame.h"
 #include "VariableWrapper.h"
 #include "utility.h"
+#include <algorithm>
 #include <cmath>
 #include <iostream>
 Op::Op() {
@@ -43,22 +49,45 @@ StartLoopOp::StartLoopOp(Executor *executor, int loops, int lineno) : prop_loops
 }
 
 StartLoopOp::~StartLoopOp() {
+    delete kernel;
 }
 
 void StartLoopOp::exec() {
-    if (!end) {
-        issueRuntimeError("END LOOP not found", getLineNo());
-    }
-
+    // the Verifier has proven that END LOOP exists and the count is non-negative
     // will execute only once, just check if loops = 0
-    loops = prop_loops;
+    loops = resume ? resume : prop_loops;
+    resume = 0;
     if (verbose) {
         std::cout << "LOOP " << loops << std::endl;
     }
 
-    if (loops < 0) {
-        issueError("loop value should be non-negative");
-    } else if (loops == 0) {
+    if (loops > 0 && kernel && !verbose) {
+        // a slice of Executor::step may end after some of the iterations
+        int run = executor->sliceIterations(loops, kernel->getBodyLength() + 1, pixelsPerIteration);
+        if (executor->jit) {
+            iterations += run;
+            if (iterations >= Jit::HOT_LOOP_ITERATIONS)
+                executor->jit->compile(kernel, "loop@" + std::to_string(getLineNo()));
+        }
+        unsigned long long pixels = executor->pixelsDrawn;
+        if (executor->bands ? executor->bands->run(kernel, run) : kernel->run(executor, run)) {
+            executor->countSliceOps(static_cast<long>(run) * (kernel->getBodyLength() + 1));
+            if (run < loops) {
+                // come back to this op with the iterations left
+                pixelsPerIteration = std::max((executor->pixelsDrawn - pixels) / run, 1ULL);
+                resume = loops - run;
+                loops = 0;
+                executor->pc--;
+                return;
+            }
+            // the whole loop has run, continue after END LOOP
+            loops = 0;
+            executor->pc += kernel->getBodyLength() + 1;
+            return;
+        }
+    }
+
+    if (loops == 0) {
         bool isEndLoop = false;
 
         while (!isEndLoop && executor->pc < executor->current_ops->size()) {
@@ -114,76 +143,42 @@ MoveOp::~MoveOp() {
 
 void MoveOp::exec() {
     int l;
-    l = _varWrapper.getValue();
+    l = _varWrapper.getValue(executor);
     if (verbose) {
         std::cout << "MOVE " << l << " steps" << std::endl;
         std::cout << "\tlogical_location:[" << executor->logical_pen_x << "," << executor->logical_pen_y << "]" << std::endl;
     }
-
-    if (executor->clocked) {
-        double dx, dy;
-        dx = l * cos(executor->degree * PI / 180.0);
-        dy = l * sin(executor->degree * PI / 180.0);
-        executor->logical_pen_x += dx;
-        executor->logical_pen_y += dy;
-    } else {
-
-        // do some real drawing
-        for (int i = 0; i < l; i++) {
-            int width = executor->penWidth;
-            int physical_pen_x = static_cast<int>(executor->logical_pen_x + 0.5);
-            int physical_pen_y = static_cast<int>(executor->logical_pen_y + 0.5);
-            for (int x = physical_pen_x - width / 2; x < physical_pen_x + width / 2 + 1; x++) {
-                for (int y = physical_pen_y - width / 2; y < physical_pen_y + width / 2 + 1; y++) {
-                    executor->drawPixel(x, y);
-                }
-            }
-            executor->logical_pen_x += 1 * cos(executor->degree * PI / 180.0);
-            executor->logical_pen_y += 1 * sin(executor->degree * PI / 180.0);
-        }
-    }
+    executor->moveTurtle(l);
 }
 
 TurnOp::~TurnOp() {
 }
 
 void TurnOp::exec() {
-    int d = varWrapper.getValue();
+    int d = varWrapper.getValue(executor);
 
     if (verbose) {
         std::cout << "TURN " << d << " degree" << std::endl;
     }
-    executor->degree -= d;
-    if (verbose) {
-        std::cout << "\tdegree state: " << executor->degree << std::endl;
-    }
-    executor->degree = (executor->degree + 360) % 360;
+    executor->turnTurtle(d);
 }
 
 ColorOp::~ColorOp() {
 }
 void ColorOp::exec() {
-    int rr = r.getValue();
-    int gg = g.getValue();
-    int bb = b.getValue();
+    if (proven && !verbose) {
+        executor->penColor = pixel;
+        executor->clocked = false;
+        return;
+    }
+    int rr = r.getValue(executor);
+    int gg = g.getValue(executor);
+    int bb = b.getValue(executor);
     if (verbose) {
         std::cout << "COLOR"
                   << "[" << rr << "," << gg << "," << bb << "]" << std::endl;
     }
-    if (rr > 255 || gg > 255 || bb > 255 || rr < 0 || gg < 0 || bb < 0) {
-        issueRuntimeWarning("Color value out of range, value larger than 255 will be set to 255, value smaller than 0 will be set 0");
-    }
-    rr = min(rr, 255);
-    rr = max(rr, 0);
-    gg = min(gg, 255);
-    gg = max(gg, 0);
-    bb = min(bb, 255);
-    bb = max(bb, 0);
-
-    Pixel pixel(rr, gg, bb, 1);
-    executor->penColor = pixel;
-    executor->clocked = false;
-    // std::cout << "ColorOp::exec() done" << std::endl;
+    executor->setPenColorValue(rr, gg, bb);
 }
 
 AddOp::AddOp(Executor *executor, VariableWrapper vw, VariableWrapper value, int lineno) : Op(executor, lineno), var(vw), value(value) {
@@ -197,12 +192,12 @@ AddOp::~AddOp() {}
 
 void AddOp::exec() {
     if (verbose) {
-        std::cout << "ADD " << var.getVariableName() << " " << value.getValue() << std::endl;
+        std::cout << "ADD " << var.getVariableName() << " " << value.getValue(executor) << std::endl;
     }
-    Variable &v = Executor::getVariableByNameStatic(var.getVariableName());
+    Variable &v = executor->getVariableBySymbol(var.getSymbol());
     if (v == Variable::noVar()) {
     } else {
-        v.addValue(value.getValue());
+        v.addValue(value.getValue(executor));
     }
 }
 
@@ -213,36 +208,44 @@ void CallOp::exec() {
                   << "args=[";
 
         for (auto it = argList.begin(); it != argList.end(); it++) {
-            std::cout << it->getValue();
+            std::cout << it->getValue(executor);
             if (it + 1 != argList.end()) {
                 std::cout << ", ";
             }
         }
         std::cout << "]" << std::endl;
     }
-    // find ops from allOps, push stack
-    Function *func = nullptr;
-    for (auto it = executor->allFunctions.begin(); it != executor->allFunctions.end(); it++) {
-        if ((*it)->getName() == name) {
-            func = *it;
-        }
-    }
+    // resolved by the Verifier, which has also checked the arguments
+    Function *func = target;
     if (func) {
         //create stack frame
-        executor->callStack.push_back(StackFrame(func, executor->pc, std::vector<Variable>()));
+        executor->pushFrame(func, executor->pc, func);
         //push args
         std::vector<VariableWrapper> &paraList = func->getParaList();
-        if (paraList.size() != argList.size()) {
-            issueRuntimeError("arguments do not match", getLineNo());
-        }
 
         for (size_t i = 0; i < argList.size(); i++) {
-            auto &frame = executor->callStack[executor->callStack.size() - 1];
-            auto &vars = frame.localVariables;
-            int argValue = argList[i].getValue();
-
-            std::string paraName = paraList[i].getVariableName();
-            vars.push_back(Variable(paraName, argValue));
+            int argValue = argList[i].getValue(executor);
+            executor->variables.push_back(Variable(paraList[i].getSymbol(), argValue));
+        }
+        // a call that draws nothing inside the buffer only moves the turtle
+        if (executor->culler && executor->culler->cull(func)) {
+            executor->popFrame();
+            return;
+        }
+        // a motif drawn before with the same pen is copied
+        if (executor->stamps && executor->stamps->draw(func)) {
+            executor->popFrame();
+            return;
+        }
+        // a hot callee made of kernel steps only runs as machine code, without switching op lists;
+        // not in a slice of Executor::step, the whole body would run at once
+        if (executor->jit && !verbose && ++calls >= Jit::HOT_CALLS && !executor->isSliced()) {
+            LoopKernel *body = executor->jit->functionKernel(func);
+            if (body && body->run(executor, 1)) {
+                executor->countSliceOps(body->getBodyLength());
+                executor->popFrame();
+                return;
+            }
         }
         executor->current_function = func;
         executor->current_ops = func->getOps();
@@ -252,7 +255,7 @@ void CallOp::exec() {
         issueRuntimeError("function " + name + " not found");
     }
 }
-DefOp::DefOp(Executor *executor, std::string name, VariableWrapper vw, int lineno) : Op(executor, lineno), name(name), varWrapper(vw) {
+DefOp::DefOp(Executor *executor, std::string name, VariableWrapper vw, int lineno) : Op(executor, lineno), varWrapper(vw), name(name), symbol(Variable::intern(name)) {
 }
 
 DefOp::~DefOp() {
@@ -260,21 +263,19 @@ DefOp::~DefOp() {
 
 void DefOp::exec() {
     if (verbose)
-        std::cout << "DEF " << name << " " << varWrapper.getValue() << std::endl;
+        std::cout << "DEF " << name << " " << varWrapper.getValue(executor) << std::endl;
     bool defined = false;
-    auto index = executor->callStack.size() - 1; // the index of the last frame
-    StackFrame &localStackFrame = executor->callStack[index];
-    std::vector<Variable> &localVars = localStackFrame.getLocalVariables();
-    // check if a variable called [name] is in localVars
-    for (auto it = localVars.begin(); it != localVars.end(); it++) {
-        if (it->getName() == name) {
+    auto &localVars = executor->variables;
+    // check if a variable called [name] is in the top frame
+    for (size_t i = executor->callStack.back().base; i < localVars.size(); i++) {
+        if (localVars[i].getSymbol() == symbol) {
             defined = true;
             break;
         }
     }
     if (!defined) {
-        // Variable *v = new Variable(name, varWrapper.getValue());
-        localVars.push_back(Variable(name, varWrapper.getValue()));
+        int value = varWrapper.getValue(executor);
+        localVars.push_back(Variable(symbol, value));
     } else {
         issueRuntimeError("Variable " + name + " is already defined");
     }
@@ -287,14 +288,13 @@ SetPenWidthOp::~SetPenWidthOp() {
 }
 
 void SetPenWidthOp::exec() {
-    int w = varWrapper.getValue();
+    int w = varWrapper.getValue(executor);
     if(verbose)
         std::cout << "PENWIDTH " << w << std::endl;
-    if (w > 0)
+    if (proven)
         executor->penWidth = w;
-    else {
-        issueError("Pen width should be larger than 1");
-    }
+    else
+        executor->setPenWidthValue(w);
 }
 
 FillOp::FillOp(Executor *executor, int lineno) : Op(executor, lineno) {
@@ -305,4 +305,51 @@ FillOp::~FillOp() {
 
 void FillOp::exec() {
     std::cout << "FILL" << std::endl;
-}
\ No newline at end of file
+}
+PixelRunOp::PixelRunOp(Executor *executor, std::vector<Pixel> colors, int lineno) : Op(executor, lineno), colors(colors) {
+}
+
+PixelRunOp::~PixelRunOp() {
+}
+
+void PixelRunOp::exec() {
+    if (verbose)
+        std::cout << "PIXEL RUN " << colors.size() << " pixels" << std::endl;
+    executor->drawPixelRun(colors.data(), colors.size());
+}
+
+InlineCallOp::InlineCallOp(Executor *executor, Function *function, std::vector<VariableWrapper> argList, int lineno) : Op(executor, lineno), function(function), argList(argList) {
+}
+
+InlineCallOp::~InlineCallOp() {
+}
+
+void InlineCallOp::exec() {
+    if (verbose)
+        std::cout << "CALL " << function->getName() << " (inlined)" << std::endl;
+    // the frame runs the ops of the current function, where the body was inlined
+    executor->pushFrame(executor->current_function, executor->pc, function);
+    // same order as CallOp: the frame is already visible while the arguments are evaluated
+    std::vector<VariableWrapper> &paraList = function->getParaList();
+    for (size_t i = 0; i < argList.size(); i++) {
+        int argValue = argList[i].getValue(executor);
+        executor->variables.push_back(Variable(paraList[i].getSymbol(), argValue));
+    }
+    if ((executor->culler && executor->culler->cull(function)) || (executor->stamps && executor->stamps->draw(function))) {
+        executor->popFrame();
+        // continue after the InlineReturnOp
+        executor->pc += bodyLength + 1;
+    }
+}
+
+InlineReturnOp::InlineReturnOp(Executor *executor, int lineno) : Op(executor, lineno) {
+}
+
+InlineReturnOp::~InlineReturnOp() {
+}
+
+void InlineReturnOp::exec() {
+    if (verbose)
+        std::cout << "return (inlined)" << std::endl;
+    executor->popFrame();
+}
@@ -1,14 +1,19 @@
 #if !defined(OP_H)
 #define OP_H
 #include <iostream>
+#include <vector>
 #include "Pixel.h"
 #include "Variable.h"
 #include "symbols.h"
 #include "VariableWrapper.h"
 class Executor;
+class LoopKernel;
+class Function;
 extern bool verbose;
 // short for operation
 class Op {
+    friend class Program;
+
 private:
 protected:
     Executor *executor = nullptr;
@@ -21,11 +26,21 @@ public:
     virtual bool isStartLoopOp() { return false; }
     virtual bool isEndLoopOp() { return false; }
     virtual bool isDefOp() { return false; }
+    virtual bool isCloakOp() { return false; }
     virtual int getLineNo() { return lineno; }
     virtual std::string OpName() { return "General Op"; }
+    // a copy for another place in the program, loop links still point to the original
+    virtual Op *clone() const = 0;
 };
 
 class MoveOp : public Op {
+    friend class Optimizer;
+    friend class CppEmitter;
+    friend class Verifier;
+    friend class CallCuller;
+    friend class CostEstimator;
+    friend class Bytecode;
+
 private:
     VariableWrapper _varWrapper;
 
@@ -38,10 +53,18 @@ public:
     }
     ~MoveOp();
     virtual void exec();
+    virtual Op *clone() const { return new MoveOp(*this); }
     virtual std::string OpName() { return "MoveOp"; }
 };
 
 class TurnOp : public Op {
+    friend class Optimizer;
+    friend class CppEmitter;
+    friend class Verifier;
+    friend class CallCuller;
+    friend class CostEstimator;
+    friend class Bytecode;
+
 private:
     VariableWrapper varWrapper;
 
@@ -54,6 +77,7 @@ public:
     }
     ~TurnOp();
     virtual void exec();
+    virtual Op *clone() const { return new TurnOp(*this); }
     virtual std::string OpName() { return "TurnOp"; }
 };
 
@@ -63,18 +87,40 @@ public:
     CloakOp(Executor *executor, int lineno = -1);
     ~CloakOp();
     virtual void exec();
+    virtual Op *clone() const { return new CloakOp(*this); }
+    virtual bool isCloakOp() { return true; }
     virtual std::string OpName() { return "CloakOp"; }
 };
 
 class StartLoopOp : public Op {
+    friend class Optimizer;
+    friend class CppEmitter;
+    friend class Verifier;
+    friend class CallCuller;
+    friend class CostEstimator;
+    friend class Program;
+    friend class Bytecode;
+
 private:
     const int prop_loops;
     int loops;
     Op *end =  nullptr;
+    LoopKernel *kernel = nullptr; // set by the Optimizer when the body can be compiled
+    long iterations = 0;          // run by the kernel so far, makes the loop hot for the Jit
+    int resume = 0;               // iterations left when a slice of Executor::step ended inside the kernel
+    unsigned long long pixelsPerIteration = 0; // measured by the last sliced kernel run, 0: not yet
 
 public:
     StartLoopOp(Executor *executor, int loops, int lineno = -1);
     virtual void exec();
+    virtual Op *clone() const {
+        StartLoopOp *op = new StartLoopOp(*this);
+        op->kernel = nullptr;
+        op->iterations = 0;
+        op->resume = 0;
+        op->pixelsPerIteration = 0;
+        return op;
+    }
     void setEndLoopOp(Op *end) { this->end = end; }
     void minusOneLoop() { loops--; }
     int getLoopRemain() { return loops; }
@@ -84,21 +130,35 @@ public:
 };
 
 class EndLoopOp : public Op {
+    friend class Optimizer;
+    friend class CppEmitter;
+    friend class Program;
+    friend class Bytecode;
+
 private:
     Op *start;
 
 public:
     EndLoopOp(Executor *executor, Op *start, int lineno = -1);
     virtual void exec();
+    virtual Op *clone() const { return new EndLoopOp(*this); }
     ~EndLoopOp();
     virtual bool isEndLoopOp() { return true; }
 };
 
 class ColorOp : public Op {
+    friend class Optimizer;
+    friend class CppEmitter;
+    friend class Verifier;
+    friend class CallCuller;
+    friend class Bytecode;
+
 private:
     VariableWrapper r;
     VariableWrapper g;
     VariableWrapper b;
+    bool proven = false; // all literal, set by the Verifier
+    Pixel pixel;
 
 public:
     ColorOp(Executor *executor, VariableWrapper r, VariableWrapper g, VariableWrapper b, int lineno = -1) : Op(executor, lineno), r(r), g(g), b(b) {
@@ -109,10 +169,18 @@ public:
     }
     ~ColorOp();
     virtual void exec();
+    virtual Op *clone() const { return new ColorOp(*this); }
     virtual std::string OpName() { return "ColorOp"; }
 };
 
 class AddOp : public Op {
+    friend class Optimizer;
+    friend class CppEmitter;
+    friend class Verifier;
+    friend class CallCuller;
+    friend class CostEstimator;
+    friend class Bytecode;
+
 private:
     VariableWrapper var;
     VariableWrapper value;
@@ -121,13 +189,24 @@ public:
     AddOp(Executor *executor, VariableWrapper vw, VariableWrapper value, int lineno = -1);
     ~AddOp();
     virtual void exec();
+    virtual Op *clone() const { return new AddOp(*this); }
     virtual std::string OpName() { return "AddOp"; }
 };
 
 class CallOp : public Op {
+    friend class Optimizer;
+    friend class CppEmitter;
+    friend class Verifier;
+    friend class CallCuller;
+    friend class CostEstimator;
+    friend class Program;
+    friend class Bytecode;
+
 private:
     std::string name;
     std::vector<VariableWrapper> argList;
+    long calls = 0; // makes the callee hot for the Jit
+    Function *target = nullptr; // resolved and arity-checked by the Verifier
 
 public:
     CallOp(Executor *executor, std::string name, std::vector<VariableWrapper> argList, int lineno = -1) : Op(executor, lineno), name(name), argList(argList) {
@@ -138,31 +217,100 @@ public:
     }
     ~CallOp();
     virtual void exec();
+    virtual Op *clone() const { return new CallOp(*this); }
     virtual std::string OpName() { return "CallOp"; }
 };
 class DefOp : public Op {
+    friend class CppEmitter;
+    friend class Verifier;
+    friend class CallCuller;
+    friend class CostEstimator;
+    friend class Program;
+    friend class Bytecode;
+
 private:
     VariableWrapper varWrapper;
     std::string name;
+    int symbol; // interned name
 
 public:
     DefOp(Executor *executor, std::string name, VariableWrapper vw, int lineno = -1);
     ~DefOp();
     virtual void exec();
+    virtual Op *clone() const { return new DefOp(*this); }
     virtual bool isDefOp() { return true; }
     virtual std::string OpName() { return "DefOp"; }
 };
 
 class SetPenWidthOp : public Op {
+    friend class Optimizer;
+    friend class CppEmitter;
+    friend class Verifier;
+    friend class CallCuller;
+    friend class CostEstimator;
+    friend class Bytecode;
+
 private:
     VariableWrapper varWrapper;
+    bool proven = false; // a positive literal, set by the Verifier
+
 public:
     SetPenWidthOp(Executor *executor, VariableWrapper vw, int lineno = -1);
     ~SetPenWidthOp();
     virtual void exec();
+    virtual Op *clone() const { return new SetPenWidthOp(*this); }
     virtual std::string OpName() { return "SetPenWidthOp"; }
 };
 
+// A run of "COLOR r g b / MOVE 1" pairs with literal operands, fused by the
+// Optimizer: every color is drawn as one pen step, in order
+class PixelRunOp : public Op {
+private:
+    std::vector<Pixel> colors;
+
+public:
+    PixelRunOp(Executor *executor, std::vector<Pixel> colors, int lineno = -1);
+    ~PixelRunOp();
+    virtual void exec();
+    virtual Op *clone() const { return new PixelRunOp(*this); }
+    size_t size() const { return colors.size(); }
+    const std::vector<Pixel> &getColors() const { return colors; }
+    virtual std::string OpName() { return "PixelRunOp"; }
+};
+
+class Function;
+
+// The start of a Function body inlined by the Optimizer at a CALL site.
+// It pushes a frame with the arguments exactly like CallOp, but the body
+// follows in the same op list, so no lookup by name or op list switch is needed.
+class InlineCallOp : public Op {
+    friend class Optimizer;
+    friend class CppEmitter;
+    friend class CallCuller;
+
+private:
+    Function *function;
+    std::vector<VariableWrapper> argList;
+    size_t bodyLength = 0; // ops of the inlined body, the InlineReturnOp follows them
+
+public:
+    InlineCallOp(Executor *executor, Function *function, std::vector<VariableWrapper> argList, int lineno = -1);
+    ~InlineCallOp();
+    virtual void exec();
+    virtual Op *clone() const { return new InlineCallOp(*this); }
+    virtual std::string OpName() { return "InlineCallOp"; }
+};
+
+// The end of an inlined Function body, pops the frame of its InlineCallOp
+class InlineReturnOp : public Op {
+public:
+    InlineReturnOp(Executor *executor, int lineno = -1);
+    ~InlineReturnOp();
+    virtual void exec();
+    virtual Op *clone() const { return new InlineReturnOp(*this); }
+    virtual std::string OpName() { return "InlineReturnOp"; }
+};
+
 class FillOp : public Op {
 private:
     
@@ -170,6 +318,7 @@ public:
     FillOp(Executor *executor, int lineno = -1);
     ~FillOp();
     virtual void exec();
+    virtual Op *clone() const { return new FillOp(*this); }
     virtual std::string OpName() { return "FillOp"; }
 };
 
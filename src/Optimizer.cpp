@@ -0,0 +1,270 @@
+#include "Optimizer.h"
+#include "Executor.h"
+#include "Function.h"
+#include "LoopKernel.h"
+#include "Op.h"
+#include <algorithm>
+#include <iostream>
+
+Optimizer::Optimizer(Executor *executor) : executor(executor) {
+}
+
+Optimizer::~Optimizer() {
+}
+
+void Optimizer::optimize() {
+    for (auto it = executor->allFunctions.begin(); it != executor->allFunctions.end(); it++) {
+        optimize(*it);
+    }
+    // inline the peephole-optimized bodies, callees first so what gets
+    // copied into a caller is already inlined; then compile loops with the result
+    std::vector<Function *> done;
+    for (auto it = executor->allFunctions.begin(); it != executor->allFunctions.end(); it++) {
+        inlineCallsBottomUp(*it, done);
+    }
+    for (auto it = executor->allFunctions.begin(); it != executor->allFunctions.end(); it++) {
+        compileLoopKernels(*(*it)->getOps());
+    }
+    if (verbose)
+        std::cout << "optimizer: " << removed << " ops removed, " << fused << " ops fused, "
+                  << inlined << " calls inlined, " << kernels << " loops compiled" << std::endl;
+}
+
+void Optimizer::optimize(Function *function) {
+    std::vector<Op *> &ops = *function->getOps();
+    dropRedundantPenOps(ops);
+    fusePixelRuns(ops);
+}
+
+// a COLOR whose value is known at compile time and that never warns
+bool Optimizer::isLiteralColor(Op *op, Pixel *pixel) {
+    ColorOp *color = dynamic_cast<ColorOp *>(op);
+    if (!color || !color->r.isLiteral() || !color->g.isLiteral() || !color->b.isLiteral())
+        return false;
+    int r = color->r.getLiteral();
+    int g = color->g.getLiteral();
+    int b = color->b.getLiteral();
+    if (r < 0 || r > 255 || g < 0 || g > 255 || b < 0 || b > 255)
+        return false;
+    if (pixel)
+        *pixel = Pixel(r, g, b, 1);
+    return true;
+}
+
+bool Optimizer::isMoveOne(Op *op) {
+    MoveOp *move = dynamic_cast<MoveOp *>(op);
+    return move && move->_varWrapper.isLiteral() && move->_varWrapper.getLiteral() == 1;
+}
+
+// COLOR followed by COLOR: the first one is overwritten
+// CLOAK followed by CLOAK: the second one does nothing
+// CLOAK followed by COLOR: COLOR takes the pen down again
+void Optimizer::dropRedundantPenOps(std::vector<Op *> &ops) {
+    std::vector<Op *> result;
+    result.reserve(ops.size());
+    for (size_t i = 0; i < ops.size(); i++) {
+        Op *op = ops[i];
+        bool redundant = false;
+        if (i + 1 < ops.size()) {
+            Op *next = ops[i + 1];
+            if (isLiteralColor(op) && dynamic_cast<ColorOp *>(next))
+                redundant = true;
+            if (op->isCloakOp() && dynamic_cast<ColorOp *>(next))
+                redundant = true;
+        }
+        if (!result.empty() && op->isCloakOp() && result.back()->isCloakOp())
+            redundant = true;
+        if (redundant) {
+            delete op;
+            removed++;
+        } else {
+            result.push_back(op);
+        }
+    }
+    ops.swap(result);
+}
+
+// "COLOR r g b / MOVE 1" pairs with literal operands become one PixelRunOp
+void Optimizer::fusePixelRuns(std::vector<Op *> &ops) {
+    std::vector<Op *> result;
+    result.reserve(ops.size());
+    size_t i = 0;
+    while (i < ops.size()) {
+        size_t j = i;
+        std::vector<Pixel> colors;
+        Pixel pixel;
+        while (j + 1 < ops.size() && isLiteralColor(ops[j], &pixel) && isMoveOne(ops[j + 1])) {
+            colors.push_back(pixel);
+            j += 2;
+        }
+        if (colors.size() >= 2) {
+            result.push_back(new PixelRunOp(executor, colors, ops[i]->getLineNo()));
+            for (size_t k = i; k < j; k++) {
+                delete ops[k];
+            }
+            fused += j - i;
+            i = j;
+        } else {
+            result.push_back(ops[i]);
+            i++;
+        }
+    }
+    ops.swap(result);
+}
+
+// every LOOP whose body only contains ops a LoopKernel can run gets one
+void Optimizer::compileLoopKernels(std::vector<Op *> &ops) {
+    for (size_t i = 0; i < ops.size(); i++) {
+        StartLoopOp *start = dynamic_cast<StartLoopOp *>(ops[i]);
+        if (!start || !start->end)
+            continue;
+        size_t j = i + 1;
+        while (j < ops.size() && ops[j] != start->end)
+            j++;
+        if (j == ops.size())
+            continue;
+        start->kernel = compileLoopKernel(ops, i + 1, j);
+        if (start->kernel)
+            kernels++;
+    }
+}
+
+static LoopKernel::Operand operand(LoopKernel *kernel, VariableWrapper &vw) {
+    if (vw.isLiteral())
+        return kernel->literal(vw.getLiteral());
+    return kernel->slot(vw.getSymbol());
+}
+
+// compile ops [begin, end), nullptr if one of them is not supported
+LoopKernel *Optimizer::compileLoopKernel(std::vector<Op *> &ops, size_t begin, size_t end) {
+    LoopKernel *kernel = new LoopKernel();
+    for (size_t i = begin; i < end; i++) {
+        Op *op = ops[i];
+        if (MoveOp *move = dynamic_cast<MoveOp *>(op)) {
+            kernel->addStep(LoopKernel::K_MOVE, operand(kernel, move->_varWrapper));
+        } else if (TurnOp *turn = dynamic_cast<TurnOp *>(op)) {
+            kernel->addStep(LoopKernel::K_TURN, operand(kernel, turn->varWrapper));
+        } else if (ColorOp *color = dynamic_cast<ColorOp *>(op)) {
+            kernel->addStep(LoopKernel::K_COLOR, operand(kernel, color->r), operand(kernel, color->g), operand(kernel, color->b));
+        } else if (op->isCloakOp()) {
+            kernel->addStep(LoopKernel::K_CLOAK);
+        } else if (AddOp *add = dynamic_cast<AddOp *>(op)) {
+            kernel->addStep(LoopKernel::K_ADD, kernel->slot(add->var.getSymbol()), operand(kernel, add->value));
+        } else if (SetPenWidthOp *width = dynamic_cast<SetPenWidthOp *>(op)) {
+            kernel->addStep(LoopKernel::K_PENWIDTH, operand(kernel, width->varWrapper));
+        } else if (PixelRunOp *run = dynamic_cast<PixelRunOp *>(op)) {
+            kernel->addStep(LoopKernel::K_PIXELRUN, LoopKernel::Operand(), LoopKernel::Operand(), LoopKernel::Operand(), run);
+        } else if (StartLoopOp *loop = dynamic_cast<StartLoopOp *>(op)) {
+            if (loop->prop_loops < 0 || !loop->end) {
+                delete kernel;
+                return nullptr;
+            }
+            kernel->addStep(LoopKernel::K_LOOP, kernel->literal(loop->prop_loops));
+        } else if (op->isEndLoopOp()) {
+            kernel->addStep(LoopKernel::K_ENDLOOP);
+        } else {
+            // CALL and DEF change the call stack, FILL is not supported
+            delete kernel;
+            return nullptr;
+        }
+    }
+    kernel->finish(end - begin);
+    return kernel;
+}
+
+// the function a CALL of [name] runs, the last definition wins like in CallOp::exec
+Function *Optimizer::findFunction(const std::string &name) {
+    Function *func = nullptr;
+    for (auto it = executor->allFunctions.begin(); it != executor->allFunctions.end(); it++) {
+        if ((*it)->getName() == name) {
+            func = *it;
+        }
+    }
+    return func;
+}
+
+// true if [function] can reach a CALL of itself
+bool Optimizer::isRecursive(Function *function) {
+    std::vector<Function *> todo(1, function);
+    std::vector<Function *> seen;
+    while (!todo.empty()) {
+        Function *f = todo.back();
+        todo.pop_back();
+        std::vector<Op *> &ops = *f->getOps();
+        for (size_t i = 0; i < ops.size(); i++) {
+            Function *callee = nullptr;
+            if (CallOp *call = dynamic_cast<CallOp *>(ops[i]))
+                callee = findFunction(call->name);
+            else if (InlineCallOp *call = dynamic_cast<InlineCallOp *>(ops[i]))
+                callee = call->function;
+            if (!callee)
+                continue;
+            if (callee == function)
+                return true;
+            if (std::find(seen.begin(), seen.end(), callee) == seen.end()) {
+                seen.push_back(callee);
+                todo.push_back(callee);
+            }
+        }
+    }
+    return false;
+}
+
+// append copies of the ops of [function] to [out], with loop links remapped
+void Optimizer::cloneBody(Function *function, std::vector<Op *> &out) {
+    std::vector<Op *> &ops = *function->getOps();
+    size_t base = out.size();
+    for (size_t i = 0; i < ops.size(); i++) {
+        out.push_back(ops[i]->clone());
+    }
+    for (size_t i = 0; i < ops.size(); i++) {
+        if (StartLoopOp *start = dynamic_cast<StartLoopOp *>(out[base + i])) {
+            size_t j = std::find(ops.begin(), ops.end(), start->end) - ops.begin();
+            start->end = j < ops.size() ? out[base + j] : nullptr;
+        } else if (EndLoopOp *end = dynamic_cast<EndLoopOp *>(out[base + i])) {
+            size_t j = std::find(ops.begin(), ops.end(), end->start) - ops.begin();
+            end->start = out[base + j];
+        }
+    }
+}
+
+void Optimizer::inlineCallsBottomUp(Function *function, std::vector<Function *> &done) {
+    if (std::find(done.begin(), done.end(), function) != done.end())
+        return;
+    done.push_back(function); // also cuts recursive cycles
+    std::vector<Op *> &ops = *function->getOps();
+    for (size_t i = 0; i < ops.size(); i++) {
+        if (CallOp *call = dynamic_cast<CallOp *>(ops[i])) {
+            Function *callee = findFunction(call->name);
+            if (callee)
+                inlineCallsBottomUp(callee, done);
+        }
+    }
+    inlineCalls(ops, function);
+}
+
+// Replace CALLs of small non-recursive functions by their body. The body
+// still gets its own frame from InlineCallOp, so DEFs and the dynamic
+// scoping of variable lookups behave exactly as in a real call.
+void Optimizer::inlineCalls(std::vector<Op *> &ops, Function *caller) {
+    std::vector<Op *> result;
+    result.reserve(ops.size());
+    for (size_t i = 0; i < ops.size(); i++) {
+        CallOp *call = dynamic_cast<CallOp *>(ops[i]);
+        Function *callee = call ? findFunction(call->name) : nullptr;
+        if (callee && callee != caller && callee->getParaList().size() == call->argList.size() &&
+            callee->getOps()->size() <= INLINE_MAX_OPS && !isRecursive(callee)) {
+            InlineCallOp *inlineCall = new InlineCallOp(executor, callee, call->argList, call->getLineNo());
+            result.push_back(inlineCall);
+            size_t bodyStart = result.size();
+            cloneBody(callee, result);
+            inlineCall->bodyLength = result.size() - bodyStart;
+            result.push_back(new InlineReturnOp(executor, call->getLineNo()));
+            delete call;
+            inlined++;
+        } else {
+            result.push_back(ops[i]);
+        }
+    }
+    ops.swap(result);
+}
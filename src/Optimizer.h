@@ -0,0 +1,48 @@
+#if !defined(OPTIMIZER_H)
+#define OPTIMIZER_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+class Executor;
+class Function;
+class Op;
+class LoopKernel;
+class CallOp;
+struct Pixel;
+
+// Peephole passes over the ops of every Function, run once after parsing.
+// Ops are only rewritten inside straight-line code: no jump ever lands
+// between two adjacent ops that are not loop or call ops.
+class Optimizer {
+private:
+    Executor *executor;
+    int removed = 0;
+    int fused = 0;
+    int kernels = 0;
+    int inlined = 0;
+    void dropRedundantPenOps(std::vector<Op *> &ops);
+    void fusePixelRuns(std::vector<Op *> &ops);
+    void inlineCalls(std::vector<Op *> &ops, Function *caller);
+    void inlineCallsBottomUp(Function *function, std::vector<Function *> &done);
+    Function *findFunction(const std::string &name);
+    bool isRecursive(Function *function);
+    void cloneBody(Function *function, std::vector<Op *> &out);
+    void compileLoopKernels(std::vector<Op *> &ops);
+    static bool isLiteralColor(Op *op, Pixel *pixel = nullptr);
+    static bool isMoveOne(Op *op);
+
+public:
+    // callees with at most this many ops are inlined at their CALL sites
+    static const size_t INLINE_MAX_OPS = 32;
+
+    Optimizer(Executor *executor);
+    ~Optimizer();
+    void optimize();
+    void optimize(Function *function);
+    // compile ops [begin, end) into a kernel, nullptr if one of them is not supported
+    static LoopKernel *compileLoopKernel(std::vector<Op *> &ops, size_t begin, size_t end);
+};
+
+#endif // OPTIMIZER_H
@@ -0,0 +1,104 @@
+#include "Options.h"
+#include "utility.h"
+#include <algorithm>
+#include <cstring>
+
+bool Options::parse(int &i, int argc, const char *const argv[]) {
+    bool hasValue = i + 1 < argc;
+    if (parseOverride(i, argc, argv)) {
+        // a value of the program
+    } else if (!strcmp(argv[i], "-o") && hasValue) {
+        outName = argv[++i];
+    } else if (!strcmp(argv[i], "--no-opt")) {
+        optimize = false;
+    } else if (!strcmp(argv[i], "--no-jit")) {
+        jit = false;
+    } else if (!strcmp(argv[i], "--no-cull")) {
+        cull = false;
+    } else if (!strcmp(argv[i], "--stamp-cache") && hasValue) {
+        stampCacheBytes = (size_t)stringToInt(argv[++i]) << 20;
+    } else if (!strcmp(argv[i], "--threads") && hasValue) {
+        threads = stringToInt(argv[++i]);
+    } else if (!strcmp(argv[i], "--front-to-back")) {
+        frontToBack = true;
+    } else if (!strcmp(argv[i], "--perf-map")) {
+        perfMap = true;
+    } else if (!strcmp(argv[i], "--frame-ops") && hasValue) {
+        frameEveryOps = stringToInt(argv[++i]);
+    } else if (!strcmp(argv[i], "--frame-pixels") && hasValue) {
+        frameEveryPixels = stringToInt(argv[++i]);
+    } else if (!strcmp(argv[i], "--frames") && hasValue) {
+        framesName = argv[++i];
+    } else if (!strcmp(argv[i], "--svg")) {
+        svg = true;
+    } else if (!strcmp(argv[i], "--viewport") && i + 4 < argc) {
+        viewport = true;
+        viewportX = stringToInt(argv[++i]);
+        viewportY = stringToInt(argv[++i]);
+        viewportW = stringToInt(argv[++i]);
+        viewportH = stringToInt(argv[++i]);
+    } else if (!strcmp(argv[i], "--dry-run")) {
+        dryRun = true;
+    } else if (!strcmp(argv[i], "--estimate")) {
+        estimate = true;
+    } else if (!strcmp(argv[i], "--mipmap") && hasValue) {
+        mipmapMinSize = stringToInt(argv[++i]);
+    } else if (!strcmp(argv[i], "--emit-cpp") && hasValue) {
+        emitCpp = argv[++i];
+    } else if (!strcmp(argv[i], "--emit-bytecode") && hasValue) {
+        emitBytecode = argv[++i];
+    } else if (!strcmp(argv[i], "--max-canvas") && hasValue) {
+        maxCanvasBytes = (size_t)stringToInt(argv[++i]) << 20;
+    } else if (!strcmp(argv[i], "--max-ops") && hasValue) {
+        maxOps = stringToLong(argv[++i]);
+    } else if (!strcmp(argv[i], "--max-pixels") && hasValue) {
+        maxPixels = stringToLong(argv[++i]);
+    } else if (!strcmp(argv[i], "--max-depth") && hasValue) {
+        maxCallDepth = stringToInt(argv[++i]);
+    } else if (!strcmp(argv[i], "--time-limit") && hasValue) {
+        timeLimitMs = stringToLong(argv[++i]);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool Options::parseOverride(int &i, int argc, const char *const argv[]) {
+    if (!strcmp(argv[i], "--set") && i + 1 < argc && strchr(argv[i + 1], '=')) {
+        const char *text = argv[++i];
+        const char *equals = strchr(text, '=');
+        values[std::string(text, equals)] = stringToInt(equals + 1);
+    } else if (!strcmp(argv[i], "--size") && i + 2 < argc) {
+        size = true;
+        width = stringToInt(argv[++i]);
+        height = stringToInt(argv[++i]);
+    } else if (!strcmp(argv[i], "--background") && i + 3 < argc) {
+        background = true;
+        backgroundR = stringToInt(argv[++i]);
+        backgroundG = stringToInt(argv[++i]);
+        backgroundB = stringToInt(argv[++i]);
+    } else if (!strcmp(argv[i], "--position") && i + 2 < argc) {
+        position = true;
+        positionX = stringToInt(argv[++i]);
+        positionY = stringToInt(argv[++i]);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+template <typename T>
+static void lower(T &limit, T ceiling) {
+    if (ceiling > 0 && (limit <= 0 || limit > ceiling))
+        limit = ceiling;
+}
+
+void Options::limitTo(const Options &ceiling) {
+    lower(maxCanvasBytes, ceiling.maxCanvasBytes);
+    lower(maxOps, ceiling.maxOps);
+    lower(maxPixels, ceiling.maxPixels);
+    lower(maxCallDepth, ceiling.maxCallDepth);
+    lower(timeLimitMs, ceiling.timeLimitMs);
+    lower(threads, ceiling.threads);
+    stampCacheBytes = std::min(stampCacheBytes, ceiling.stampCacheBytes);
+}
@@ -0,0 +1,69 @@
+#if !defined(OPTIONS_H)
+#define OPTIONS_H
+
+#include <map>
+#include <string>
+
+// Command line options, filled by main() and handed to the Interpreter
+struct Options {
+    std::string outName; // empty: derive from the input file name
+
+    // animation export, 0 means disabled
+    long frameEveryOps = 0;    // emit a frame every N executed ops
+    long frameEveryPixels = 0; // emit a frame every N drawn pixels
+    std::string framesName;    // empty: derive from the output file name
+
+    bool svg = false; // write the path as SVG instead of rasterizing a BMP
+
+    // render only a w x h window of the canvas, geometry is still computed for the whole canvas
+    bool viewport = false;
+    int viewportX = 0, viewportY = 0, viewportW = 0, viewportH = 0;
+
+    bool optimize = true; // run the peephole optimizer after parsing
+
+    bool jit = true;      // compile hot loops and functions to machine code, needs optimize
+    bool perfMap = false; // describe the compiled code in /tmp/perf-<pid>.map for perf
+
+    bool cull = true; // skip calls that draw nothing inside the canvas, only moving the turtle
+    size_t stampCacheBytes = 0; // reuse the pixels of calls that repeat a motif, up to this many bytes; 0 disables
+
+    int threads = 0; // rasterize compiled loops on this many threads; 0: one per core, 1: as they run
+    bool frontToBack = false; // record all drawing and rasterize it last to first, storing each pixel once
+
+    bool dryRun = false; // only report the geometry, no image is rendered
+    bool estimate = false; // only report the predicted cost, nothing is run
+
+    int mipmapMinSize = 0; // write a 1/2, 1/4, ... pyramid down to this size, 0 means disabled
+
+    std::string emitCpp; // non-empty: write the program as a C++ renderer to this file instead of rendering
+    std::string emitBytecode; // non-empty: write the parsed program to this file instead of rendering, see Bytecode
+
+    // resource limits, 0: none; a program that exceeds one stops with an error naming it
+    size_t maxCanvasBytes = 0;        // the pixel buffer
+    long long maxOps = 0;             // ops executed, every iteration of a compiled loop counts its body
+    unsigned long long maxPixels = 0; // pixel writes, every pixel of the pen footprint counts, on the canvas or not
+    int maxCallDepth = 0;             // nested calls
+    long timeLimitMs = 0;             // wall-clock time from the start of the run
+
+    // the program rendered with other values than its text has, see Program
+    std::map<std::string, int> values; // --set NAME=VALUE: initial values of the DEFs outside of the functions
+    bool size = false;                 // --size W H in place of @SIZE
+    int width = 0, height = 0;
+    bool background = false;           // --background R G B in place of @BACKGROUND
+    int backgroundR = 0, backgroundG = 0, backgroundB = 0;
+    bool position = false;             // --position X Y in place of @POSITION
+    int positionX = 0, positionY = 0;
+
+    bool quiet = false; // no "write to file" line or statistics, a batch reports every job itself
+
+    // read the option at argv[i] and its values, leaving i on the last one;
+    // false if argv[i] is not an option of the rendering
+    bool parse(int &i, int argc, const char *const argv[]);
+    // parse() for the options that change the program: --set, --size, --background, --position
+    bool parseOverride(int &i, int argc, const char *const argv[]);
+    // lower the resource limits to those of ceiling where it has one, the
+    // threads to ceiling's unless it has one per core, and the stamp cache to ceiling's
+    void limitTo(const Options &ceiling);
+};
+
+#endif // OPTIONS_H
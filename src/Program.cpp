@@ -0,0 +1,63 @@
+#include "Program.h"
+#include "Function.h"
+#include "Op.h"
+
+std::shared_ptr<const Program> Program::compile(const std::string &source, LogoError &error) {
+    std::shared_ptr<Program> program(new Program());
+    Interpreter &text = program->parsed;
+    if (!text.stage([&] { text.readProgram(text.openSource(source)); })) {
+        error = text.error;
+        return nullptr;
+    }
+    return program;
+}
+
+std::shared_ptr<const Program> Program::compileFile(const std::string &filename, LogoError &error) {
+    std::shared_ptr<Program> program(new Program());
+    Interpreter &text = program->parsed;
+    if (!text.stage([&] { text.readFile(filename.c_str()); })) {
+        error = text.error;
+        return nullptr;
+    }
+    program->name = filename;
+    return program;
+}
+
+// The ops are cloned as the Optimizer clones a body it inlines, then bound to
+// executor: loops are linked to their copies, which nest like the originals
+// (the Verifier has proven it), and calls to the copies of their targets.
+void Program::copyTo(Executor &executor, const std::map<std::string, int> &values) const {
+    const std::vector<Function *> &functions = parsed.executor.allFunctions;
+    std::map<Function *, Function *> copies;
+    copies[functions[0]] = executor.allFunctions[0];
+    for (size_t f = 1; f < functions.size(); f++) {
+        Function *copy = new Function(functions[f]->getName(), functions[f]->getParaList());
+        executor.allFunctions.push_back(copy);
+        copies[functions[f]] = copy;
+    }
+    for (size_t f = 0; f < functions.size(); f++) {
+        std::vector<Op *> &ops = *functions[f]->getOps();
+        std::vector<Op *> &out = *copies[functions[f]]->getOps();
+        std::vector<StartLoopOp *> loops; // open in the copy
+        out.reserve(ops.size());
+        for (size_t i = 0; i < ops.size(); i++) {
+            Op *op = ops[i]->clone();
+            op->executor = &executor;
+            if (StartLoopOp *start = dynamic_cast<StartLoopOp *>(op)) {
+                loops.push_back(start);
+            } else if (EndLoopOp *end = dynamic_cast<EndLoopOp *>(op)) {
+                end->start = loops.back();
+                loops.back()->end = end;
+                loops.pop_back();
+            } else if (CallOp *call = dynamic_cast<CallOp *>(op)) {
+                call->target = call->target ? copies[call->target] : nullptr;
+            } else if (DefOp *def = dynamic_cast<DefOp *>(op)) {
+                auto value = values.find(def->name);
+                if (f == 0 && value != values.end())
+                    def->varWrapper = VariableWrapper(value->second);
+            }
+            out.push_back(op);
+        }
+    }
+    executor.lastLine = parsed.executor.lastLine;
+}
@@ -0,0 +1,37 @@
+#if !defined(PROGRAM_H)
+#define PROGRAM_H
+
+#include "Interpreter.h"
+#include "utility.h"
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+
+// A program scanned, parsed and proven once, for any number of renders:
+// Interpreter::load(program) copies its ops into an Executor of its own, which
+// optimizes, compiles and runs them with the values of that render's Options
+// (--set, --size, --background, --position). Nothing in a Program changes
+// after compile(), so one can be loaded by many Interpreters on many threads
+// at once.
+class Program {
+    friend class Interpreter;
+
+private:
+    Interpreter parsed; // the program text, never configured or run
+    std::string name;   // the file it was read from, which names the output, or empty
+
+    Program() {}
+    // copy every function into executor, which has not parsed anything, with
+    // the DEFs outside of the functions starting from values where it names them
+    void copyTo(Executor &executor, const std::map<std::string, int> &values) const;
+
+public:
+    // nullptr on an error, which is then in error
+    static std::shared_ptr<const Program> compile(const std::string &source, LogoError &error);
+    static std::shared_ptr<const Program> compileFile(const std::string &filename, LogoError &error);
+    // the DEFs outside of the functions, which Options::values may set
+    const std::set<std::string> &getParameters() const { return parsed.parameters; }
+};
+
+#endif // PROGRAM_H
@@ -0,0 +1,267 @@
+#include "Server.h"
+#include "Interpreter.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iterator>
+#include <sstream>
+#include <thread>
+#include <vector>
+#if defined(__unix__) || defined(__APPLE__)
+#include <csignal>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#define SERVER_UNIX
+#endif
+
+#if defined(SERVER_UNIX)
+// buffered reads and whole writes on a connected socket
+namespace {
+class Connection {
+private:
+    int fd;
+    char buffer[4096];
+    size_t begin = 0, end = 0;
+
+    bool fill() {
+        ssize_t n;
+        do {
+            n = ::read(fd, buffer, sizeof(buffer));
+        } while (n < 0 && errno == EINTR);
+        if (n <= 0)
+            return false;
+        begin = 0;
+        end = n;
+        return true;
+    }
+
+public:
+    explicit Connection(int fd) : fd(fd) {}
+    // a line without its '\n', false at the end of the connection
+    bool readLine(std::string &line, size_t limit) {
+        line.clear();
+        while (true) {
+            if (begin == end && !fill())
+                return false;
+            char *newline = static_cast<char *>(memchr(buffer + begin, '\n', end - begin));
+            size_t n = newline ? newline - (buffer + begin) : end - begin;
+            line.append(buffer + begin, n);
+            begin += n;
+            if (newline) {
+                begin++;
+                return true;
+            }
+            if (line.size() > limit)
+                return false;
+        }
+    }
+    bool read(std::string &data, size_t size) {
+        data.clear();
+        data.reserve(size);
+        while (data.size() < size) {
+            if (begin == end && !fill())
+                return false;
+            size_t n = std::min(size - data.size(), end - begin);
+            data.append(buffer + begin, n);
+            begin += n;
+        }
+        return true;
+    }
+    bool write(const std::string &data) {
+        size_t done = 0;
+        while (done < data.size()) {
+            ssize_t n = ::write(fd, data.data() + done, data.size() - done);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                return false;
+            done += n;
+        }
+        return true;
+    }
+};
+} // namespace
+#endif
+
+Server::Server(const Options &defaults) : defaults(defaults), pool(POOL_BYTES) {
+    this->defaults.quiet = true;
+    // one program that asks for too much must not take the daemon down with it
+    if (!this->defaults.maxCanvasBytes)
+        this->defaults.maxCanvasBytes = MAX_CANVAS;
+    if (!this->defaults.timeLimitMs)
+        this->defaults.timeLimitMs = TIME_LIMIT_MS;
+}
+
+Server::~Server() {
+#if defined(SERVER_UNIX)
+    if (listener >= 0) {
+        close(listener);
+        unlink(path.c_str());
+    }
+#endif
+}
+
+bool Server::listen(const std::string &path, std::string &error) {
+#if defined(SERVER_UNIX)
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+        error = "socket path is too long";
+        return false;
+    }
+    strcpy(address.sun_path, path.c_str());
+    listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0) {
+        error = strerror(errno);
+        return false;
+    }
+    unlink(path.c_str());
+    if (bind(listener, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0 || ::listen(listener, 128) < 0) {
+        error = strerror(errno);
+        close(listener);
+        listener = -1;
+        return false;
+    }
+    this->path = path;
+    return true;
+#else
+    error = "Unix domain sockets are not supported on this platform";
+    return false;
+#endif
+}
+
+void Server::serve(int threads) {
+#if defined(SERVER_UNIX)
+    // a client that goes away while its image is sent must not end the daemon
+    signal(SIGPIPE, SIG_IGN);
+    int count = threads > 0 ? threads : std::thread::hardware_concurrency();
+    admitted = std::max(count, 1);
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(connectionMutex);
+            connectionClosed.wait(lock, [this] { return connections < MAX_CONNECTIONS; });
+        }
+        int fd = accept(listener, nullptr, nullptr);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(connectionMutex);
+            connections++;
+        }
+        try {
+            std::thread([this, fd] {
+                try {
+                    serveConnection(fd);
+                } catch (const std::exception &) {
+                    // out of memory for the response: drop this connection, not the daemon
+                }
+                closeConnection(fd);
+            }).detach();
+        } catch (const std::exception &) {
+            closeConnection(fd); // no thread for it: refuse it
+        }
+    }
+#endif
+}
+
+void Server::closeConnection(int fd) {
+#if defined(SERVER_UNIX)
+    close(fd);
+    {
+        std::lock_guard<std::mutex> lock(connectionMutex);
+        connections--;
+    }
+    connectionClosed.notify_one();
+#endif
+}
+
+void Server::acquireSlot() {
+    std::unique_lock<std::mutex> lock(slotMutex);
+    unsigned long ticket = nextTicket++;
+    slotFree.wait(lock, [this, ticket] { return ticket < admitted; });
+}
+
+void Server::releaseSlot() {
+    {
+        std::lock_guard<std::mutex> lock(slotMutex);
+        admitted++;
+    }
+    slotFree.notify_all();
+}
+
+void Server::serveConnection(int fd) {
+#if defined(SERVER_UNIX)
+    Connection connection(fd);
+    std::string header;
+    while (connection.readLine(header, 4096)) {
+        std::istringstream fields(header);
+        std::string verb;
+        size_t size = 0;
+        std::string source, output, image, error;
+        if (!(fields >> verb >> size) || verb != "RENDER" || size > MAX_PROGRAM) {
+            error = "Error: expecting \"RENDER <bytes> [options]\"";
+            connection.write("ERROR " + std::to_string(error.size()) + "\n" + error);
+            return; // the rest of the connection cannot be framed
+        }
+        std::string optionText;
+        std::getline(fields, optionText);
+        if (!connection.read(source, size))
+            return;
+        bool ok = render(optionText, source, output, image, error);
+        std::string response = ok ? "OK " + std::to_string(image.size()) + " " + output + "\n" + image
+                                  : "ERROR " + std::to_string(error.size()) + "\n" + error;
+        if (!connection.write(response))
+            return;
+    }
+#endif
+}
+
+#if defined(SERVER_UNIX)
+bool Server::render(const std::string &optionText, const std::string &source, std::string &output, std::string &image,
+                    std::string &error) {
+    Options options = defaults;
+    std::istringstream words(optionText);
+    std::vector<std::string> args((std::istream_iterator<std::string>(words)), std::istream_iterator<std::string>());
+    std::vector<const char *> argv;
+    for (size_t i = 0; i < args.size(); i++)
+        argv.push_back(args[i].c_str());
+    for (int i = 0; i < static_cast<int>(argv.size()); i++) {
+        if (!options.parse(i, argv.size(), argv.data())) {
+            error = "Error: unknown option " + args[i];
+            return false;
+        }
+    }
+    // a request may ask for tighter limits than the daemon's, not looser ones
+    options.limitTo(defaults);
+    // the daemon writes no file where a client says, with its own rights, and
+    // what would be printed goes nowhere
+    if (!options.outName.empty() || !options.framesName.empty() || options.frameEveryOps > 0 ||
+        options.frameEveryPixels > 0 || options.mipmapMinSize > 0 || !options.emitCpp.empty() ||
+        !options.emitBytecode.empty() || options.dryRun || options.estimate || options.perfMap) {
+        error = "Error: -o, --frames, --frame-ops, --frame-pixels, --mipmap, --emit-cpp, --emit-bytecode, --dry-run, "
+                "--estimate and --perf-map cannot be used with the daemon";
+        return false;
+    }
+    output = "-"; // the image is sent back
+
+    Interpreter interpreter;
+    interpreter.setOptions(options);
+    interpreter.setBufferPool(&pool);
+    Slot slot(*this);
+    bool ok = interpreter.loadSource(source, output.c_str());
+    bool more = ok;
+    while (more) {
+        slot.yield();
+        ok = interpreter.renderSlice(SLICE_OPS, SLICE_PIXELS, more);
+    }
+    ok = ok && interpreter.encodeTo(image);
+    if (!ok)
+        error = interpreter.getError().message;
+    return ok;
+}
+#endif
@@ -0,0 +1,84 @@
+#if !defined(SERVER_H)
+#define SERVER_H
+
+#include "BufferPool.h"
+#include "Options.h"
+#include <condition_variable>
+#include <mutex>
+#include <string>
+
+// A render daemon on a Unix domain socket. Every connection has a thread that
+// reads its requests and renders each one with an Interpreter of its own; at
+// most a fixed number of them run at once, the others wait for a slot in the
+// order they asked for it. At most MAX_CONNECTIONS connections are served at
+// once, the clients above wait in the backlog of the socket until one ends. A program runs in slices of SLICE_OPS ops or
+// SLICE_PIXELS pixels (Executor::step) and gives up its slot after each, so a
+// short program waits for a slice of the long ones, not for all of them.
+// The threads, the allocator and the pixel buffers of the BufferPool stay
+// warm between requests.
+//
+// A connection carries any number of requests, one after the other:
+//   request:  "RENDER <n> [options]\n" and n bytes of program text, where the
+//             options are those of the command line that render, e.g. "--svg"
+//   response: "OK <n> -\n" and the n bytes of the image;
+//             "ERROR <n>\n" and the n bytes of the error message
+// The daemon writes no file for a client, so the options that name one (-o,
+// --frames, --mipmap, ...) are refused. A request may lower the limits of the
+// daemon, which has a canvas and a time limit even if none is given, and
+// gets at most its --threads and --stamp-cache, see Options::limitTo.
+class Server {
+public:
+    static const size_t MAX_PROGRAM = 64 << 20; // longer programs are refused
+    static const size_t POOL_BYTES = 256 << 20; // pixel buffers kept for reuse
+    static const long SLICE_OPS = 1 << 16;
+    static const unsigned long long SLICE_PIXELS = 1 << 22;
+    static const size_t MAX_CANVAS = 256 << 20; // --max-canvas unless the daemon is given one
+    static const long TIME_LIMIT_MS = 30000;    // --time-limit unless the daemon is given one
+    static const int MAX_CONNECTIONS = 256;
+
+private:
+    Options defaults;
+    std::string path;
+    int listener = -1;
+    BufferPool pool;
+    // a slot goes to tickets in order: ticket t may run once t < admitted
+    std::mutex slotMutex;
+    std::condition_variable slotFree;
+    unsigned long nextTicket = 0;
+    unsigned long admitted = 1;
+    // connections that have a thread, at most MAX_CONNECTIONS
+    std::mutex connectionMutex;
+    std::condition_variable connectionClosed;
+    int connections = 0;
+
+    void acquireSlot();
+    void releaseSlot();
+    // a slot held by a request until it ends, however it ends
+    class Slot {
+    private:
+        Server &server;
+
+    public:
+        explicit Slot(Server &server) : server(server) { server.acquireSlot(); }
+        ~Slot() { server.releaseSlot(); }
+        // let the requests that wait for a slot go first
+        void yield() {
+            server.releaseSlot();
+            server.acquireSlot();
+        }
+    };
+    void closeConnection(int fd);
+    void serveConnection(int fd);
+    bool render(const std::string &optionText, const std::string &source, std::string &output, std::string &image,
+                std::string &error);
+
+public:
+    explicit Server(const Options &defaults);
+    ~Server();
+    // bind the socket, replacing a stale one; false with the reason in error
+    bool listen(const std::string &path, std::string &error);
+    // render at most threads requests at once, 0 for one per core, until the process ends
+    void serve(int threads);
+};
+
+#endif // SERVER_H
@@ -5,15 +5,15 @@
 #include <vector>
 
 class Function;
+// The locals of a frame are Executor::variables[base, base of the next frame),
+// so pushing and popping a frame never allocates.
 struct StackFrame {
 
     Function *function;
     size_t ret_pc;
-    std::vector<Variable> localVariables;
+    size_t base;
 
-    StackFrame(Function *function, size_t pc, std::vector<Variable> args) : function(function), ret_pc(pc), localVariables(args) {}
-    ~StackFrame();
-    std::vector<Variable> &getLocalVariables() { return localVariables; }
+    StackFrame(Function *function, size_t pc, size_t base) : function(function), ret_pc(pc), base(base) {}
 };
 
 #endif // STACKFRAME_H
@@ -0,0 +1,247 @@
+#include "StampCache.h"
+#include "BandRenderer.h"
+#include "CallCuller.h"
+#include "Executor.h"
+#include "Function.h"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <iostream>
+
+bool StampCache::Key::operator<(const Key &other) const {
+    if (summary != other.summary)
+        return summary < other.summary;
+    if (r != other.r)
+        return r < other.r;
+    if (g != other.g)
+        return g < other.g;
+    if (b != other.b)
+        return b < other.b;
+    if (binadeX != other.binadeX)
+        return binadeX < other.binadeX;
+    return binadeY < other.binadeY;
+}
+
+StampCache::StampCache(Executor *executor, size_t capacity) : executor(executor), capacity(capacity) {
+    culler = executor->culler;
+    if (!culler)
+        culler = ownCuller = new CallCuller(executor);
+}
+
+StampCache::~StampCache() {
+    for (auto it = stamps.begin(); it != stamps.end(); it++)
+        for (size_t i = 0; i < it->second.size(); i++)
+            delete it->second[i];
+    delete ownCuller;
+}
+
+// Whether [lo, hi] lies in one binade, where adding a whole number to a double
+// is exact, and so are all the additions made after it. Positions below 1 are
+// left out, the cast to int does not round them down.
+static bool binadeOf(double lo, double hi, int &binade) {
+    if (lo < 1)
+        return false;
+    int e;
+    frexp(lo, &binade);
+    frexp(hi, &e);
+    return binade == e;
+}
+
+// distance from p to the nearest position where static_cast<int>(p + 0.5) changes
+static double roundingMargin(double p) {
+    double d = (p + 0.5) - floor(p + 0.5);
+    return std::min(d, 1 - d);
+}
+
+// Walk the pen from (x, y) as replay does, keeping the smallest rounding margin
+// of the positions a pixel is drawn at and counting the additions.
+void StampCache::measure(const CallCuller::Summary *summary, double &x, double &y, double &marginX, double &marginY,
+                         long &additions) {
+    for (auto it = summary->segments.begin(); it != summary->segments.end(); it++) {
+        if (it->kind == CallCuller::Segment::CALL) {
+            measure(it->call, x, y, marginX, marginY, additions);
+            continue;
+        }
+        double cx = Executor::degreeCos(it->degree);
+        double cy = Executor::degreeSin(it->degree);
+        if (it->kind == CallCuller::Segment::CLOAK) {
+            x += it->steps * cx;
+            y += it->steps * cy;
+            additions++;
+            continue;
+        }
+        int steps = it->run ? it->run->size() : it->steps;
+        for (int i = 0; i < steps; i++) {
+            marginX = std::min(marginX, roundingMargin(x));
+            marginY = std::min(marginY, roundingMargin(y));
+            x += cx;
+            y += cy;
+        }
+        additions += steps;
+    }
+}
+
+// Rasterize the call into a scratch buffer covering canvas [x0, x1] x [y0, y1],
+// moving the pen as the body does, and keep what it drew.
+StampCache::Stamp *StampCache::record(const CallCuller::Summary *summary, int x0, int y0, int x1, int y1, int binadeX,
+                                      int binadeY) {
+    double fx = floor(executor->logical_pen_x);
+    double fy = floor(executor->logical_pen_y);
+    Stamp *stamp = new Stamp();
+    stamp->phaseX = executor->logical_pen_x - fx;
+    stamp->phaseY = executor->logical_pen_y - fy;
+
+    // every addition rounds by at most half a unit in the last place, for the
+    // recorded call and for the reusing one; p + 0.5 rounds once more
+    double x = executor->logical_pen_x;
+    double y = executor->logical_pen_y;
+    double marginX = 1, marginY = 1;
+    long additions = 0;
+    measure(summary, x, y, marginX, marginY, additions);
+    stamp->marginX = marginX - (additions + 2) * ldexp(1.0, binadeX - 53);
+    stamp->marginY = marginY - (additions + 2) * ldexp(1.0, binadeY - 53);
+
+    int w = x1 - x0 + 1;
+    int h = y1 - y0 + 1;
+    std::vector<Pixel> scratch(w * h, Pixel(0, 0, 0, 0)); // pen colors have alpha 1
+
+    unsigned char *buffer = executor->buffer;
+    int originX = executor->originX;
+    int originY = executor->originY;
+    int width = executor->width;
+    int height = executor->height;
+    int dirtyX0 = executor->dirtyX0, dirtyY0 = executor->dirtyY0;
+    int dirtyX1 = executor->dirtyX1, dirtyY1 = executor->dirtyY1;
+    unsigned long long pixelsDrawn = executor->pixelsDrawn;
+    executor->buffer = reinterpret_cast<unsigned char *>(scratch.data());
+    executor->originX = x0;
+    executor->originY = y0;
+    executor->width = w;
+    executor->height = h;
+    culler->replay(summary, true);
+    stamp->pixelsDrawn = executor->pixelsDrawn - pixelsDrawn;
+    executor->buffer = buffer;
+    executor->originX = originX;
+    executor->originY = originY;
+    executor->width = width;
+    executor->height = height;
+    executor->dirtyX0 = dirtyX0;
+    executor->dirtyY0 = dirtyY0;
+    executor->dirtyX1 = dirtyX1;
+    executor->dirtyY1 = dirtyY1;
+    executor->pixelsDrawn = pixelsDrawn;
+
+    stamp->x0 = stamp->y0 = INT_MAX;
+    stamp->x1 = stamp->y1 = INT_MIN;
+    for (int r = 0; r < h; r++) {
+        const Pixel *row = scratch.data() + r * w;
+        for (int c = 0; c < w; c++) {
+            if (row[c].alpha == 0)
+                continue;
+            int start = c;
+            while (c < w && row[c].alpha != 0)
+                c++;
+            Run run = {y0 + r - static_cast<int>(fy), x0 + start - static_cast<int>(fx), c - start, stamp->colors.size()};
+            stamp->runs.push_back(run);
+            stamp->colors.insert(stamp->colors.end(), row + start, row + c);
+            stamp->x0 = std::min(stamp->x0, run.dx);
+            stamp->x1 = std::max(stamp->x1, run.dx + run.length - 1);
+            stamp->y0 = std::min(stamp->y0, run.dy);
+            stamp->y1 = std::max(stamp->y1, run.dy);
+        }
+    }
+    stamp->bytes = sizeof(Stamp) + stamp->runs.size() * sizeof(Run) + stamp->colors.size() * sizeof(Pixel);
+    return stamp;
+}
+
+// x, y: the whole-pixel pen position on the canvas
+void StampCache::blit(const Stamp *stamp, int x, int y) {
+    if (stamp->runs.empty())
+        return;
+    x -= executor->originX;
+    y -= executor->originY;
+    Pixel *pixels = reinterpret_cast<Pixel *>(executor->buffer);
+    for (auto it = stamp->runs.begin(); it != stamp->runs.end(); it++)
+        std::copy(stamp->colors.begin() + it->first, stamp->colors.begin() + it->first + it->length,
+                  pixels + (y + it->dy) * executor->width + x + it->dx);
+    executor->markDirty(x + stamp->x0, y + stamp->y0, x + stamp->x1, y + stamp->y1);
+    executor->pixelsDrawn += stamp->pixelsDrawn;
+}
+
+bool StampCache::draw(Function *function) {
+    // front to back the drawing is recorded, stamps would be stored out of order;
+    // a pixel limit counts the lines as they are drawn
+    if (executor->svg || executor->dryRun || executor->recorder || verbose || (executor->bands && executor->bands->isRecording()) ||
+        executor->maxPixels)
+        return false;
+    Usage &use = usage[function];
+    if (++use.calls < CallCuller::HOT_CALLS)
+        return false;
+    // positions that never repeat their phase only cost memory
+    if (use.misses >= GIVE_UP_MISSES && use.hits * HIT_RATIO < use.misses)
+        return false;
+    const CallCuller::Summary *summary = culler->summarizeTop(function);
+    if (!summary || !summary->draws)
+        return false;
+
+    // nothing the call draws may be clipped, two pixels of slack cover the rounding
+    double x = executor->logical_pen_x;
+    double y = executor->logical_pen_y;
+    int x0 = static_cast<int>(floor(x + summary->x0)) - 2;
+    int y0 = static_cast<int>(floor(y + summary->y0)) - 2;
+    int x1 = static_cast<int>(ceil(x + summary->x1)) + 2;
+    int y1 = static_cast<int>(ceil(y + summary->y1)) + 2;
+    Key key;
+    if (x0 < executor->originX || y0 < executor->originY || x1 >= executor->originX + executor->width ||
+        y1 >= executor->originY + executor->height ||
+        !binadeOf(x + std::min(summary->x0, summary->px0) - 2, x + std::max(summary->x1, summary->px1) + 2, key.binadeX) ||
+        !binadeOf(y + std::min(summary->y0, summary->py0) - 2, y + std::max(summary->y1, summary->py1) + 2, key.binadeY)) {
+        skipped++;
+        return false;
+    }
+    double fx = floor(x);
+    double fy = floor(y);
+    key.summary = summary;
+    key.r = executor->penColor.r;
+    key.g = executor->penColor.g;
+    key.b = executor->penColor.b;
+
+    std::vector<Stamp *> &phases = stamps[key];
+    const Stamp *found = nullptr;
+    for (size_t i = 0; i < phases.size() && !found; i++)
+        if (fabs(x - fx - phases[i]->phaseX) < phases[i]->marginX && fabs(y - fy - phases[i]->phaseY) < phases[i]->marginY)
+            found = phases[i];
+    if (found) {
+        blit(found, fx, fy);
+        culler->replay(summary);
+        hits++;
+        use.hits++;
+    } else {
+        if (used + static_cast<size_t>(x1 - x0 + 1) * (y1 - y0 + 1) * sizeof(Pixel) > capacity) {
+            skipped++;
+            return false;
+        }
+        Stamp *stamp = record(summary, x0, y0, x1, y1, key.binadeX, key.binadeY);
+        blit(stamp, fx, fy);
+        if (phases.size() < MAX_PHASES && stamp->marginX > 0 && stamp->marginY > 0 && used + stamp->bytes <= capacity) {
+            phases.push_back(stamp);
+            used += stamp->bytes;
+            stampCount++;
+        } else {
+            delete stamp;
+        }
+        misses++;
+        use.misses++;
+    }
+    executor->degree = summary->degree;
+    executor->penWidth = summary->penWidth;
+    executor->clocked = summary->clocked;
+    if (summary->colorSet)
+        executor->penColor = summary->color;
+    return true;
+}
+
+void StampCache::printStatistics() {
+    std::cout << "stamp cache: " << hits << " hits, " << misses << " misses, " << skipped << " calls not cacheable, "
+              << used << " bytes in " << stampCount << " stamps" << std::endl;
+}
@@ -0,0 +1,85 @@
+#if !defined(STAMPCACHE_H)
+#define STAMPCACHE_H
+
+#include "CallCuller.h"
+#include "Pixel.h"
+#include <cstddef>
+#include <map>
+#include <vector>
+
+class Executor;
+class Function;
+
+// Remembers the pixels a call draws and copies them for later calls that
+// draw the same motif somewhere else. A stamp is keyed by the summary of the
+// call (function, argument values, heading, pen width, cloak; see CallCuller),
+// the pen color and the binades of the positions the call walks through.
+// Within one binade [2^e, 2^(e+1)) moving by a whole number of pixels shifts
+// every addition exactly, so what is left is the sub-pixel phase of the start:
+// a stamp records how far each drawing position is from rounding to another
+// pixel, and is reused for any phase closer to its own than that, less what the
+// additions may round differently on the way. The copy is then exactly what
+// running the body would draw; the turtle is still moved by replaying the
+// additions, so it ends on exactly the same position. Calls are only cached
+// where nothing they draw is clipped by the buffer.
+class StampCache {
+private:
+    struct Key {
+        const void *summary;
+        int r, g, b;
+        int binadeX, binadeY;
+        bool operator<(const Key &other) const;
+    };
+    // pixels [dx, dx + length) of row dy, relative to the whole-pixel pen position
+    struct Run {
+        int dy;
+        int dx;
+        int length;
+        size_t first; // index of the first color
+    };
+    struct Stamp {
+        std::vector<Run> runs;
+        std::vector<Pixel> colors;
+        int x0, y0, x1, y1;           // bounds of the runs
+        double phaseX, phaseY;        // sub-pixel phase of the recorded call
+        double marginX, marginY;      // how far the phase may move before a pixel changes
+        unsigned long long pixelsDrawn; // as counted by the rasterizer
+        size_t bytes;
+    };
+    Executor *executor;
+    CallCuller *culler;
+    CallCuller *ownCuller = nullptr; // when calls are not culled
+    size_t capacity;
+    size_t used = 0;
+    std::map<Key, std::vector<Stamp *>> stamps;
+    size_t stampCount = 0;
+    struct Usage {
+        long calls = 0;
+        long hits = 0;
+        long misses = 0;
+    };
+    std::map<Function *, Usage> usage;
+    long hits = 0;
+    long misses = 0;
+    long skipped = 0;
+
+    void measure(const CallCuller::Summary *summary, double &x, double &y, double &marginX, double &marginY, long &additions);
+    Stamp *record(const CallCuller::Summary *summary, int x0, int y0, int x1, int y1, int binadeX, int binadeY);
+    void blit(const Stamp *stamp, int x, int y);
+
+public:
+    // a function stops being recorded when it has missed this often without
+    // hitting for at least one in HIT_RATIO of its misses
+    static const long GIVE_UP_MISSES = 64;
+    static const long HIT_RATIO = 4;
+    static const size_t MAX_PHASES = 16; // stamps kept for one key
+
+    StampCache(Executor *executor, size_t capacity);
+    ~StampCache();
+    // called with the frame of the call pushed and its arguments bound; true if
+    // the drawing came from the cache, the caller then only pops the frame
+    bool draw(Function *function);
+    void printStatistics();
+};
+
+#endif // STAMPCACHE_H
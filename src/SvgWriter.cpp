@@ -0,0 +1,103 @@
+#include "SvgWriter.h"
+#include <cmath>
+#include <cstdarg>
+#include <cstdio>
+SvgWriter::SvgWriter() : background(255, 255, 255, 1) {
+}
+
+SvgWriter::~SvgWriter() {
+}
+
+void SvgWriter::setCanvas(int width, int height) {
+    this->width = width;
+    this->height = height;
+}
+
+static bool sameColor(const Pixel &a, const Pixel &b) {
+    return a.r == b.r && a.g == b.g && a.b == b.b;
+}
+
+void SvgWriter::segment(double x0, double y0, double x1, double y1, Pixel color, int penWidth) {
+    if (!lines.empty()) {
+        Polyline &last = lines.back();
+        size_t n = last.points.size();
+        if (sameColor(last.color, color) && last.width == penWidth &&
+            last.points[n - 2] == x0 && last.points[n - 1] == y0) {
+            // continue the polyline, fold the previous point if it is collinear
+            if (n >= 4) {
+                double px = last.points[n - 4], py = last.points[n - 3];
+                double cross = (x0 - px) * (y1 - y0) - (y0 - py) * (x1 - x0);
+                double dot = (x0 - px) * (x1 - x0) + (y0 - py) * (y1 - y0);
+                if (std::fabs(cross) < 1e-9 && dot > 0) {
+                    last.points[n - 2] = x1;
+                    last.points[n - 1] = y1;
+                    return;
+                }
+            }
+            last.points.push_back(x1);
+            last.points.push_back(y1);
+            return;
+        }
+    }
+    Polyline line;
+    line.color = color;
+    line.width = penWidth;
+    line.points.push_back(x0);
+    line.points.push_back(y0);
+    line.points.push_back(x1);
+    line.points.push_back(y1);
+    lines.push_back(line);
+}
+
+// printf into the end of out
+static void append(std::string &out, const char *format, ...) {
+    char text[256];
+    va_list args, again;
+    va_start(args, format);
+    va_copy(again, args);
+    int n = vsnprintf(text, sizeof(text), format, args);
+    if (n >= static_cast<int>(sizeof(text))) {
+        size_t size = out.size();
+        out.resize(size + n + 1);
+        vsnprintf(&out[size], n + 1, format, again);
+        out.resize(size + n);
+    } else if (n > 0) {
+        out.append(text, n);
+    }
+    va_end(again);
+    va_end(args);
+}
+
+size_t SvgWriter::EncodeSVG(std::string &image) {
+    image.clear();
+    append(image, "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"%d\" height=\"%d\" viewBox=\"0 0 %d %d\">\n",
+           width, height, width, height);
+    append(image, "<rect width=\"100%%\" height=\"100%%\" fill=\"rgb(%d,%d,%d)\"/>\n",
+           background.r, background.g, background.b);
+    for (size_t i = 0; i < lines.size(); i++) {
+        const Polyline &line = lines[i];
+        // a pen of width w covers w/2*2+1 pixels, centered on the pen position
+        append(image, "<polyline fill=\"none\" stroke=\"rgb(%d,%d,%d)\" stroke-width=\"%d\" stroke-linecap=\"square\" points=\"",
+               line.color.r, line.color.g, line.color.b, line.width / 2 * 2 + 1);
+        for (size_t j = 0; j + 1 < line.points.size(); j += 2) {
+            // pixel y grows upwards, svg y grows downwards
+            append(image, "%s%.2f,%.2f", j ? " " : "", line.points[j] + 0.5, height - (line.points[j + 1] + 0.5));
+        }
+        image += "\"/>\n";
+    }
+    image += "</svg>\n";
+    return image.size();
+}
+
+size_t SvgWriter::WriteSVG(std::string filename) {
+    std::string image;
+    EncodeSVG(image);
+    FILE *fp;
+    fp = fopen(filename.c_str(), "w");
+    if (!fp) {
+        return 0;
+    }
+    bool ok = fwrite(image.data(), 1, image.size(), fp) == image.size();
+    ok = fclose(fp) == 0 && ok;
+    return ok ? 1 : 0;
+}
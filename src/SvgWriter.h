@@ -0,0 +1,36 @@
+#if !defined(SVGWRITER_H)
+#define SVGWRITER_H
+
+#include "Pixel.h"
+#include <string>
+#include <vector>
+
+// Collects the turtle path as vector strokes and writes it as SVG.
+// Consecutive segments sharing a style are merged into one polyline,
+// collinear points are folded, so the output scales with the number of
+// direction changes rather than with the number of pixels.
+class SvgWriter {
+private:
+    struct Polyline {
+        Pixel color;
+        int width;
+        std::vector<double> points; // x0 y0 x1 y1 ..., in logical coordinates
+    };
+    int width = 0;
+    int height = 0;
+    Pixel background;
+    std::vector<Polyline> lines;
+
+public:
+    SvgWriter();
+    ~SvgWriter();
+    void setCanvas(int width, int height);
+    void setBackground(Pixel background) { this->background = background; }
+    void segment(double x0, double y0, double x1, double y1, Pixel color, int penWidth);
+    size_t getPolylineCount() const { return lines.size(); }
+    // the document into image, replacing what it held; its size
+    size_t EncodeSVG(std::string &image);
+    size_t WriteSVG(std::string filename);
+};
+
+#endif // SVGWRITER_H
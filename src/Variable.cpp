@@ -1,24 +1,79 @@
+
 #include "Variable.h"
 #include "utility.h"
 #include "VariableWrapper.h"
-Variable noVarInstance("noVar", 0);
 
-Variable::Variable(std::string name, int initValue) : _value(initValue), _name(name), id(nextID++) {
+Variable::Variable(std::string name, int initValue) : _value(initValue), _symbol(intern(name)) {
 //    std::cout << "debug: new Var: " << _name << " value=" << _value << std::endl;
 }
 
 Variable::~Variable() {
 }
 
-int Variable::nextID = 0;
+namespace {
+thread_local SymbolTable *currentTable = nullptr;
+}
+
+int SymbolTable::intern(const std::string &name) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = symbols.find(name);
+    if (it != symbols.end())
+        return it->second;
+    int symbol = names.size();
+    names.push_back(name);
+    symbols[name] = symbol;
+    return symbol;
+}
+
+int SymbolTable::find(const std::string &name) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = symbols.find(name);
+    return it == symbols.end() ? -1 : it->second;
+}
+
+const std::string &SymbolTable::name(int symbol) {
+    std::lock_guard<std::mutex> lock(mutex);
+    return names[symbol];
+}
+
+// a function-local static, so interning works during static initialization
+SymbolTable &SymbolTable::current() {
+    static SymbolTable process;
+    return currentTable ? *currentTable : process;
+}
+
+SymbolTable::Scope::Scope(SymbolTable &table) : previous(currentTable) {
+    currentTable = &table;
+}
+
+SymbolTable::Scope::~Scope() {
+    currentTable = previous;
+}
+
+int Variable::intern(const std::string &name) {
+    return SymbolTable::current().intern(name);
+}
+
+int Variable::findSymbol(const std::string &name) {
+    return SymbolTable::current().find(name);
+}
+
+const std::string &Variable::symbolName(int symbol) {
+    return SymbolTable::current().name(symbol);
+}
 
+// variables are values on the executor's variable stack, identity is the slot they live in
 bool operator==(const Variable &lhs, const Variable &rhs) {
-    return lhs.id == rhs.id;
+    return &lhs == &rhs;
 }
 
+// the sentinel lookups return when no frame defines a name, it is compared by
+// address and never written, so one instance serves every interpreter; it has
+// no name in any of their tables
 Variable &
 Variable::noVar() {
-    return noVarInstance;
+    static Variable instance(-1, 0);
+    return instance;
 }
 
 bool operator!=(const Variable &lhs, const Variable &rhs) {
@@ -5,6 +5,38 @@
 #include <set>
 #include <map>
 #include <vector>
+#include <deque>
+#include <mutex>
+
+// the names interned by one program, numbered in the order they come. Every
+// Interpreter has one, which is current on its thread while it works (see
+// Scope), so the names of a program go away with the last Interpreter that
+// runs it; outside of any the table of the process is current.
+class SymbolTable
+{
+private:
+    std::deque<std::string> names; // keeps the names returned by name() in place while others are added
+    std::map<std::string, int> symbols;
+    std::mutex mutex; // the Interpreters that load a Program share its table
+
+public:
+    int intern(const std::string &name);
+    int find(const std::string &name); // -1 if the name was never interned
+    const std::string &name(int symbol);
+    static SymbolTable &current();
+
+    // make a table current on this thread until the end of the scope
+    class Scope
+    {
+    private:
+        SymbolTable *previous;
+
+    public:
+        explicit Scope(SymbolTable &table);
+        ~Scope();
+    };
+};
+
 class Variable
 {
     friend bool operator==(const Variable &lhs, const Variable &rhs);
@@ -12,26 +44,31 @@ class Variable
 
 private:
     ValueType _value;
-    std::string _name;
-    const int id;
-    static int nextID;
+    int _symbol; // interned name, see intern()
     bool isConst = false;
 
-
 public:
     Variable(std::string name, int initValue);
+    Variable(int symbol, int initValue) : _value(initValue), _symbol(symbol) {}
     ~Variable();
     ValueType getValue() const
     {
         return _value;
     }
     void addValue(int value) { _value += value; }
-    std::string getName() const { return _name; }
+    int *valuePtr() { return &_value; }
+    std::string getName() const { return symbolName(_symbol); }
+    int getSymbol() const { return _symbol; }
     // static Variable &getVariableByName(std::string name);
     // static void deleteVariableByName(std::string name);
     static  Variable &noVar();
+
+    // names are interned while parsing, so frames hold no strings at run time;
+    // these use SymbolTable::current()
+    static int intern(const std::string &name);
+    static int findSymbol(const std::string &name); // -1 if the name was never interned
+    static const std::string &symbolName(int symbol);
 };
-extern Variable noVarInstance;
 
 bool operator==(const Variable &lhs, const Variable &rhs);
 bool operator!=(const Variable &lhs, const Variable &rhs);
@@ -39,5 +76,3 @@ bool operator!=(const Variable &lhs, const Variable &rhs);
 
 
 #endif // VARIABLE_H
-
-
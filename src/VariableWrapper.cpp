@@ -11,15 +11,15 @@ VariableWrapper::~VariableWrapper() {
 VariableWrapper::VariableWrapper(Variable *var) : _variable(var) {
     isVar = true;
 }
-VariableWrapper::VariableWrapper(std::string varName) : varName(varName) {
+VariableWrapper::VariableWrapper(std::string varName) : varName(varName), symbol(Variable::intern(varName)) {
     isVar = true;
 }
-int VariableWrapper::getValue() const {
+int VariableWrapper::getValue(Executor *executor) const {
     if (isVar) {
         if (_variable) {
             return _variable->getValue();
         } else {
-            auto &v = Executor::getVariableByNameStatic(varName);
+            auto &v = executor->getVariableBySymbol(symbol);
             if (v == Variable::noVar()) {
                 issueRuntimeError("cannot find variable " + varName);
                 return v.getValue(); // value is not defined
@@ -43,3 +43,9 @@ std::string VariableWrapper::getVariableName() const {
         return "$NO_NAME$";
     }
 }
+
+int VariableWrapper::getSymbol() const {
+    if (isVar && _variable)
+        return _variable->getSymbol();
+    return symbol;
+}
@@ -2,6 +2,7 @@
 #define VARIABLEWRAPPER_H
 #include <string>
 
+class Executor;
 class Variable;
 
 class VariableWrapper {
@@ -9,6 +10,7 @@ private:
     Variable *_variable = nullptr;
     int _value = 0;
     std::string varName;
+    int symbol = -1; // interned varName
     bool isVar = false;
 
 public:
@@ -16,12 +18,15 @@ public:
     VariableWrapper(int value);
     VariableWrapper(std::string varName);
     ~VariableWrapper();
-    bool isLiteral() const { return _variable == 0; }
+    bool isLiteral() const { return !isVar; }
     bool isVariable() const {
-        return _variable != 0;
+        return isVar;
     }
     std::string getVariableName() const;
-    int getValue() const;
+    int getSymbol() const;
+    // the value of a literal, or of the variable the name is bound to in the executor
+    int getValue(Executor *executor) const;
+    int getLiteral() const { return _value; }
 };
 
 #endif // VARIABLEWRAPPER_H
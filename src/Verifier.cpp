@@ -0,0 +1,195 @@
+#include "Verifier.h"
+#include "Executor.h"
+#include "Function.h"
+#include "Op.h"
+#include <algorithm>
+#include <iostream>
+
+Verifier::Verifier(Executor *executor) : executor(executor) {
+}
+
+Verifier::~Verifier() {
+}
+
+// the last definition of a name wins, as in CallOp
+Function *Verifier::findFunction(const std::string &name) {
+    Function *result = nullptr;
+    for (auto it = executor->allFunctions.begin(); it != executor->allFunctions.end(); it++) {
+        if ((*it)->getName() == name)
+            result = *it;
+    }
+    return result;
+}
+
+bool Verifier::isBound(int symbol) const {
+    for (auto it = frames.begin(); it != frames.end(); it++) {
+        if (it->count(symbol))
+            return true;
+    }
+    return false;
+}
+
+void Verifier::error(int lineno, const std::string &message) {
+    std::pair<int, std::string> e(lineno, message);
+    if (std::find(errors.begin(), errors.end(), e) == errors.end())
+        errors.push_back(e);
+}
+
+// what the text of a function decides, whether or not it ever runs
+void Verifier::checkText(Function *function) {
+    std::vector<Op *> &ops = *function->getOps();
+    for (size_t i = 0; i < ops.size(); i++) {
+        Op *op = ops[i];
+        if (StartLoopOp *loop = dynamic_cast<StartLoopOp *>(op)) {
+            if (!loop->end)
+                error(op->getLineNo(), "END LOOP not found");
+            if (loop->prop_loops < 0)
+                error(op->getLineNo(), "loop value should be non-negative");
+        } else if (CallOp *call = dynamic_cast<CallOp *>(op)) {
+            Function *callee = findFunction(call->name);
+            if (!callee)
+                error(op->getLineNo(), "function " + call->name + " not found");
+            else if (callee->getParaList().size() != call->argList.size())
+                error(op->getLineNo(), "arguments do not match");
+        } else if (SetPenWidthOp *width = dynamic_cast<SetPenWidthOp *>(op)) {
+            if (width->varWrapper.isLiteral() && width->varWrapper.getLiteral() <= 0)
+                error(op->getLineNo(), "Pen width should be larger than 1");
+        } else if (ColorOp *color = dynamic_cast<ColorOp *>(op)) {
+            // clamped here once instead of on every execution
+            VariableWrapper *channels[3] = {&color->r, &color->g, &color->b};
+            bool clamped = false;
+            for (int c = 0; c < 3; c++) {
+                if (!channels[c]->isLiteral())
+                    continue;
+                int v = channels[c]->getLiteral();
+                if (v < 0 || v > 255) {
+                    *channels[c] = VariableWrapper(std::max(std::min(v, 255), 0));
+                    clamped = true;
+                }
+            }
+            if (clamped)
+                std::cout << "Warning at " << op->getLineNo() << ": Color value out of range, value larger than 255 will be set to 255, value smaller than 0 will be set 0" << std::endl;
+        }
+    }
+}
+
+void Verifier::checkRead(Op *op, int symbol, const std::set<int> *calleeFrame) {
+    if (calleeFrame && calleeFrame->count(symbol))
+        return;
+    if (!isBound(symbol))
+        error(op->getLineNo(), "cannot find variable " + Variable::symbolName(symbol));
+}
+
+// Follow one execution of function, whose frame is frames.back(). Control flow
+// only depends on literal loop counts, so this visits exactly the ops that run;
+// a loop body is walked once, with the names bound before its first pass,
+// which is the fewest it ever sees (a DEF in a body that runs twice fails).
+void Verifier::walk(Function *function) {
+    std::vector<Op *> &ops = *function->getOps();
+    std::vector<bool> outerRepeated;
+    bool repeated = false; // the current op runs more than once per call
+    for (size_t i = 0; i < ops.size(); i++) {
+        Op *op = ops[i];
+        if (StartLoopOp *loop = dynamic_cast<StartLoopOp *>(op)) {
+            if (!loop->end || loop->prop_loops < 0)
+                return; // execution stops here
+            if (loop->prop_loops == 0) {
+                while (ops[i] != loop->end)
+                    i++;
+                continue;
+            }
+            outerRepeated.push_back(repeated);
+            repeated = repeated || loop->prop_loops > 1;
+        } else if (op->isEndLoopOp()) {
+            repeated = outerRepeated.back();
+            outerRepeated.pop_back();
+        } else if (MoveOp *move = dynamic_cast<MoveOp *>(op)) {
+            if (move->_varWrapper.isVariable())
+                checkRead(op, move->_varWrapper.getSymbol());
+        } else if (TurnOp *turn = dynamic_cast<TurnOp *>(op)) {
+            if (turn->varWrapper.isVariable())
+                checkRead(op, turn->varWrapper.getSymbol());
+        } else if (SetPenWidthOp *width = dynamic_cast<SetPenWidthOp *>(op)) {
+            if (width->varWrapper.isVariable())
+                checkRead(op, width->varWrapper.getSymbol());
+        } else if (ColorOp *color = dynamic_cast<ColorOp *>(op)) {
+            VariableWrapper *channels[3] = {&color->r, &color->g, &color->b};
+            for (int c = 0; c < 3; c++) {
+                if (channels[c]->isVariable())
+                    checkRead(op, channels[c]->getSymbol());
+            }
+        } else if (AddOp *add = dynamic_cast<AddOp *>(op)) {
+            // adding to an undefined name does nothing, the value is not read then
+            if (isBound(add->var.getSymbol()) && add->value.isVariable())
+                checkRead(op, add->value.getSymbol());
+        } else if (DefOp *def = dynamic_cast<DefOp *>(op)) {
+            if (frames.back().count(def->symbol) || repeated)
+                error(op->getLineNo(), "Variable " + def->name + " is already defined");
+            frames.back().insert(def->symbol);
+        } else if (CallOp *call = dynamic_cast<CallOp *>(op)) {
+            Function *callee = findFunction(call->name);
+            if (!callee || callee->getParaList().size() != call->argList.size())
+                return; // reported by checkText, execution stops here
+            // the callee's frame is pushed before its arguments are read
+            std::vector<VariableWrapper> &paraList = callee->getParaList();
+            std::set<int> calleeFrame;
+            for (size_t k = 0; k < call->argList.size(); k++) {
+                if (call->argList[k].isVariable())
+                    checkRead(op, call->argList[k].getSymbol(), &calleeFrame);
+                calleeFrame.insert(paraList[k].getSymbol());
+            }
+            std::set<int> visible;
+            for (auto it = frames.begin(); it != frames.end(); it++)
+                visible.insert(it->begin(), it->end());
+            visible.insert(calleeFrame.begin(), calleeFrame.end());
+            // the same function with the same names bound behaves the same,
+            // this also ends the walk of a recursion (which never terminates)
+            if (walked.insert(std::make_pair(callee, visible)).second) {
+                frames.push_back(calleeFrame);
+                walk(callee);
+                frames.pop_back();
+            }
+        }
+    }
+}
+
+// switch proven ops to the forms that skip their checks
+void Verifier::specialize(Function *function) {
+    std::vector<Op *> &ops = *function->getOps();
+    for (size_t i = 0; i < ops.size(); i++) {
+        Op *op = ops[i];
+        if (CallOp *call = dynamic_cast<CallOp *>(op)) {
+            call->target = findFunction(call->name);
+        } else if (ColorOp *color = dynamic_cast<ColorOp *>(op)) {
+            if (color->r.isLiteral() && color->g.isLiteral() && color->b.isLiteral()) {
+                color->pixel = Pixel(color->r.getLiteral(), color->g.getLiteral(), color->b.getLiteral(), 1);
+                color->proven = true;
+            }
+        } else if (SetPenWidthOp *width = dynamic_cast<SetPenWidthOp *>(op)) {
+            width->proven = width->varWrapper.isLiteral();
+        }
+    }
+}
+
+bool Verifier::verify(std::string &report) {
+    for (auto it = executor->allFunctions.begin(); it != executor->allFunctions.end(); it++)
+        checkText(*it);
+    // the program starts in the global function with an empty frame
+    frames.assign(1, std::set<int>());
+    walk(executor->allFunctions[0]);
+
+    if (!errors.empty()) {
+        std::stable_sort(errors.begin(), errors.end(), [](const std::pair<int, std::string> &a, const std::pair<int, std::string> &b) {
+            return a.first < b.first;
+        });
+        report.clear();
+        for (auto it = errors.begin(); it != errors.end(); it++)
+            report += (report.empty() ? "" : "\n") + ("Error at line " + std::to_string(it->first) + ": " + it->second);
+        return false;
+    }
+    for (auto it = executor->allFunctions.begin(); it != executor->allFunctions.end(); it++)
+        specialize(*it);
+    if (verbose)
+        std::cout << "verifier: program proven, " << walked.size() + 1 << " function contexts walked" << std::endl;
+    return true;
+}
@@ -0,0 +1,47 @@
+#if !defined(VERIFIER_H)
+#define VERIFIER_H
+
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+class Executor;
+class Function;
+class Op;
+
+// Proves after parsing what the ops used to check on every execution, and
+// reports every violation with its line number at once:
+//  - every LOOP has its END LOOP and a non-negative count,
+//  - every CALL names a function and passes the right number of arguments,
+//  - every variable read finds a definition in the frames that are live
+//    when it runs (names are dynamically scoped, so each function body is
+//    walked once for every distinct set of names its callers have bound),
+//  - no DEF runs twice in one frame,
+//  - literal pen widths are positive, literal colors are clamped once here.
+// Unreachable code (after LOOP 0, in functions never called) is only
+// checked for what the program text decides on its own.
+// Once the program is proven, the ops are switched to their check-free forms.
+class Verifier {
+private:
+    Executor *executor;
+    std::vector<std::pair<int, std::string>> errors; // line, message
+    std::vector<std::set<int>> frames;               // names bound in each live frame
+    std::set<std::pair<Function *, std::set<int>>> walked;
+
+    Function *findFunction(const std::string &name);
+    bool isBound(int symbol) const;
+    void error(int lineno, const std::string &message);
+    void checkText(Function *function);
+    void checkRead(Op *op, int symbol, const std::set<int> *calleeFrame = nullptr);
+    void walk(Function *function);
+    void specialize(Function *function);
+
+public:
+    Verifier(Executor *executor);
+    ~Verifier();
+    // return false with every error in report, or specialize the ops and return true
+    bool verify(std::string &report);
+};
+
+#endif // VERIFIER_H
@@ -1,13 +1,126 @@
+#include "Batch.h"
 #include "Interpreter.h"
+#include "Server.h"
+#include "utility.h"
+#include <cstring>
 #include <iostream>
+#include <vector>
 
 bool verbose = false;
+
+static void usage() {
+    std::cerr << "Usage: LogoCompiler input.logo... [options]" << std::endl
+              << "       LogoCompiler --batch MANIFEST [options]" << std::endl
+              << "       LogoCompiler --serve SOCKET [options]" << std::endl
+              << "  -o FILE                 output bmp file" << std::endl
+              << "  -v                      verbose" << std::endl
+              << "  --no-opt                execute the ops as parsed, without optimization" << std::endl
+              << "  --no-jit                interpret hot loops and functions instead of compiling them" << std::endl
+              << "  --perf-map              write /tmp/perf-<pid>.map for the compiled code" << std::endl
+              << "  --no-cull               run calls that draw outside the canvas instead of skipping them" << std::endl
+              << "  --stamp-cache MB        copy the pixels of calls that repeat a motif, caching up to MB megabytes" << std::endl
+              << "  --threads N             rasterize compiled loops on N threads (default: one per core)" << std::endl
+              << "  --front-to-back         rasterize the drawing last to first, storing every pixel once" << std::endl
+              << "  --frame-ops N           record an animation frame every N ops" << std::endl
+              << "  --frame-pixels N        record an animation frame every N drawn pixels" << std::endl
+              << "  --frames FILE           animation output file (default: <output>.frames)" << std::endl
+              << "  --svg                   write the path as SVG, skip rasterization" << std::endl
+              << "  --viewport X Y W H      only rasterize the W x H window at canvas position X Y" << std::endl
+              << "  --dry-run               report bounding box, turtle state and cost without rendering" << std::endl
+              << "  --estimate              predict ops, pixel writes, memory and render time without running" << std::endl
+              << "  --mipmap MIN            also write 1/2, 1/4, ... thumbnails down to MIN pixels" << std::endl
+              << "  --emit-cpp FILE         write a standalone C++ renderer of the program instead of rendering" << std::endl
+              << "  --set NAME=VALUE        start the DEF of NAME outside of the functions from VALUE" << std::endl
+              << "  --size W H              render at W x H in place of @SIZE" << std::endl
+              << "  --background R G B      in place of @BACKGROUND" << std::endl
+              << "  --position X Y          in place of @POSITION" << std::endl
+              << "  --emit-bytecode FILE    write the parsed program to FILE (.logoc), which runs in place of the text" << std::endl
+              << "  --max-canvas MB         stop programs whose canvas needs more than MB megabytes" << std::endl
+              << "  --max-ops N             stop programs after N executed ops" << std::endl
+              << "  --max-pixels N          stop programs after N pixel writes" << std::endl
+              << "  --max-depth N           stop programs that nest calls deeper than N" << std::endl
+              << "  --time-limit MS         stop programs still running after MS milliseconds" << std::endl
+              << "  --batch MANIFEST        render every \"input [output] [--set ...]\" line of MANIFEST, like several input files" << std::endl
+              << "  --jobs N                render N files at once (default: one per core)" << std::endl
+              << "  --serve SOCKET          render the programs sent to the Unix socket SOCKET, N at once with --jobs N," << std::endl
+              << "                          with --max-canvas 256 and --time-limit 30000 unless given" << std::endl;
+}
+
 int main(int argc, char const *argv[]) {
     if(argc<2){
         std::cerr<< "Error: No input file."<<std::endl;
         return -1;
     }
+    Options options;
+    std::vector<const char *> inputs;
+    const char *manifest = nullptr;
+    const char *socketPath = nullptr;
+    int jobs = 0;
+    for (int i = 1; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+        if (options.parse(i, argc, argv)) {
+            // a rendering option
+        } else if (!strcmp(argv[i], "-v")) {
+            verbose = true;
+        } else if (!strcmp(argv[i], "--batch") && hasValue) {
+            manifest = argv[++i];
+        } else if (!strcmp(argv[i], "--serve") && hasValue) {
+            socketPath = argv[++i];
+        } else if (!strcmp(argv[i], "--jobs") && hasValue) {
+            jobs = stringToInt(argv[++i]);
+        } else if (argv[i][0] == '-' && argv[i][1] != '\0') {
+            std::cerr << "Error: unknown option " << argv[i] << std::endl;
+            usage();
+            return -1;
+        } else {
+            inputs.push_back(argv[i]);
+        }
+    }
+    if (socketPath) {
+        if (!inputs.empty() || manifest || verbose) {
+            std::cerr << "Error: --serve cannot be used with input files, --batch or -v." << std::endl;
+            return -1;
+        }
+        // requests are rendered side by side, each one on its own thread
+        if (!options.threads)
+            options.threads = 1;
+        Server server(options);
+        std::string error;
+        if (!server.listen(socketPath, error)) {
+            std::cerr << "Error: cannot listen on " << socketPath << ": " << error << std::endl;
+            return 1;
+        }
+        server.serve(jobs);
+        return 0;
+    }
+    if (inputs.empty() && !manifest) {
+        std::cerr << "Error: No input file." << std::endl;
+        return -1;
+    }
+    if (manifest || inputs.size() > 1) {
+        if (!options.outName.empty() || !options.emitCpp.empty() || !options.emitBytecode.empty() || options.dryRun || options.estimate || options.perfMap ||
+            !options.framesName.empty() || verbose) {
+            std::cerr << "Error: several input files cannot be used with -o, -v, --emit-cpp, --emit-bytecode, --dry-run, --estimate, --perf-map or --frames." << std::endl;
+            return -1;
+        }
+        // the files already use every core, each one is rasterized on its own thread
+        if (!options.threads)
+            options.threads = 1;
+        Batch batch(options);
+        for (size_t i = 0; i < inputs.size(); i++)
+            batch.add(inputs[i]);
+        std::string error;
+        if (manifest && !batch.readManifest(manifest, error)) {
+            std::cerr << "Error: " << error << std::endl;
+            return -1;
+        }
+        return batch.run(jobs) ? 1 : 0;
+    }
     Interpreter i;
-    i.compile(argv[1]);
+    i.setOptions(options);
+    if (!i.compile(inputs[0])) {
+        i.getError().print();
+        return 1;
+    }
     return 0;
 }
@@ -1,8 +1,7 @@
 #include "symbols.h"
 #include "utility.h"
-std::queue<Symbol> lexQueue;
+thread_local std::queue<Symbol> *scanQueue = nullptr;
 Symbol::Symbol(SymbolType st) : type(st) {
-    extern int yylineno;
     lineno = yylineno;
 }
 
@@ -35,7 +34,6 @@ std::string symbolTypeName[] = {
 Symbol::~Symbol() {
 }
 Symbol::Symbol(SymbolType st, int value, std::string name) : type(st), value(value), name(name) {
-    extern int yylineno;
     lineno = yylineno;
     // std::cout <<"line "<< lineno << std::endl;
 }
@@ -55,23 +53,21 @@ const std::string &Symbol::getName() const {
 
 int keyword(SymbolType st) {
     // std::cout<< "keyword: code = "<<st<< std::endl;
-    lexQueue.push(Symbol(st));
+    scanQueue->push(Symbol(st));
     return st;
 }
 int intConst(const char *s) {
-    lexQueue.push(Symbol::intConst(s));
+    scanQueue->push(Symbol::intConst(s));
     // std::cout<< "intConst: "<<s<< std::endl;
     return INTCONST;
 }
 int identifier(const char *s) {
-    lexQueue.push(Symbol::identifier(s));
+    scanQueue->push(Symbol::identifier(s));
     // std::cout<<"identifier: "<< s<< std::endl;
     return IDENTIFIER;
 }
 void issueError(const char *text) {
-    extern int yylineno;
-    std::printf("Error at line %d: %s\n", yylineno, text);
-    exit(1);
+    throw LogoError("Error at line " + std::to_string(yylineno) + ": " + text, true);
 }
 
 extern "C" {
@@ -4,9 +4,16 @@
 #include <queue>
 #include <string>
 
+#include <cstdio>
+
+// the scanner generated from Lexer.l; its state is per thread, one file is
+// scanned at a time on each thread
 extern "C" {
 int yylex(void);
 }
+int yylex_destroy(void);
+extern thread_local FILE *yyin;
+extern thread_local int yylineno;
 const int SYMBOL_TYPE_START_NO = 30000;
 enum SymbolType {
     MOVE = SYMBOL_TYPE_START_NO,
@@ -63,7 +70,8 @@ public:
     ~Symbol();
 };
 
-extern std::queue<Symbol> lexQueue;
+// where the scanner puts the symbols it reads, set by the Interpreter for a scan
+extern thread_local std::queue<Symbol> *scanQueue;
 
 int keyword(SymbolType st);
 
@@ -2,6 +2,7 @@
 #define UTILITY_MY_H
 
 #include <algorithm>
+#include <cstdio>
 #include <fstream>
 #include <iostream>
 #include <sstream>
@@ -19,14 +20,43 @@ inline int stringToInt(std::string s) {
     return result;
 }
 
+inline long long stringToLong(std::string s) {
+    long long result;
+    std::istringstream(s) >> result;
+    return result;
+}
+
+// An error that stops the program. It is thrown where the error is found and
+// Interpreter::compile returns it, leaving the report to its caller.
+struct LogoError {
+    std::string message; // one line per error
+    bool onStdout;       // reported on stdout, as the scanner reports, else on stderr
+    std::string limit;   // the resource limit the program exceeded, see Options, or empty
+
+    explicit LogoError(std::string message, bool onStdout = false) : message(message), onStdout(onStdout) {}
+    void print() const {
+        if (onStdout)
+            std::printf("%s\n", message.c_str());
+        else
+            std::cerr << message << std::endl;
+    }
+};
+
 inline void issueRuntimeError(std::string err, int lineno=-1) {
     if (lineno == -1) {
-        std::cerr << "Runtime Error: " << err << std::endl;
+        throw LogoError("Runtime Error: " + err);
     } else {
-        std::cerr << "Runtime Error at line " << lineno << ": " << err << std::endl;
+        throw LogoError("Runtime Error at line " + std::to_string(lineno) + ": " + err);
     }
-    exit(1);
 }
+
+// a resource limit of the Options was exceeded, limit names it
+inline void issueLimitError(const std::string &limit, const std::string &err) {
+    LogoError error("Limit Error: " + err);
+    error.limit = limit;
+    throw error;
+}
+
 inline void issueRuntimeWarning(std::string err) {
     std::cout << "Runtime warning: " << err << std::endl;
 }
@@ -0,0 +1,110 @@
+// Asserts that a CALL and its return do not touch the heap, for an interpreted
+// callee and for one compiled to a kernel: the same program runs with 1000
+// and with 100000 calls, and the second run may only make the
+// few allocations more that the warm-up of the culler and the Jit varies by;
+// one per call would be 99000. Built and run by `make check` in src/.
+#include "Interpreter.h"
+#include "Optimizer.h"
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+
+bool verbose = false;
+
+static std::atomic<unsigned long> allocations(0);
+static const unsigned long SLACK = 8;
+
+void *operator new(size_t size) {
+    allocations++;
+    if (void *p = malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void *operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void *p) noexcept {
+    free(p);
+}
+
+void operator delete[](void *p) noexcept {
+    free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+    free(p);
+}
+
+void operator delete[](void *p, size_t) noexcept {
+    free(p);
+}
+
+// a callee with a parameter and a DEF in its frame, which is interpreted
+static std::string withDef() {
+    return "FUNC step(angle)\n    DEF length 1\n    MOVE length\n    TURN angle\nEND FUNC\n";
+}
+
+// a callee without a DEF, too long to be inlined, which runs as a kernel and
+// by default as machine code
+static std::string compiled() {
+    std::string body;
+    for (size_t i = 0; i <= Optimizer::INLINE_MAX_OPS / 2; i++)
+        body += "    MOVE 1\n    TURN angle\n";
+    return "FUNC step(angle)\n" + body + "END FUNC\n";
+}
+
+// allocations made by render() of a program that calls function [calls] times
+static unsigned long renderAllocations(const std::string &function, int calls, const Options &options) {
+    std::string source = "@SIZE 100 100\n@BACKGROUND 0 0 0\n@POSITION 50 50\n" + function + "LOOP " +
+                         std::to_string(calls) + "\n    CALL step(90)\nEND LOOP\n";
+    Interpreter interpreter;
+    interpreter.setOptions(options);
+    if (!interpreter.loadSource(source, "/dev/null")) {
+        fprintf(stderr, "alloc_check: %s\n", interpreter.getError().message.c_str());
+        exit(2);
+    }
+    unsigned long before = allocations;
+    if (!interpreter.render()) {
+        fprintf(stderr, "alloc_check: %s\n", interpreter.getError().message.c_str());
+        exit(2);
+    }
+    return allocations - before;
+}
+
+int main() {
+    struct Case {
+        const char *name;
+        Options options;
+    } cases[4];
+    cases[0].name = "default";
+    cases[1].name = "--no-opt";
+    cases[1].options.optimize = false;
+    cases[2].name = "--no-jit --no-cull";
+    cases[2].options.jit = false;
+    cases[2].options.cull = false;
+    cases[3].name = "--no-opt --no-cull"; // every call through pushFrame/popFrame
+    cases[3].options.optimize = false;
+    cases[3].options.cull = false;
+    struct Callee {
+        const char *name;
+        std::string function;
+    } callees[2] = {{"DEF", withDef()}, {"compiled", compiled()}};
+    int failed = 0;
+    for (int c = 0; c < 2; c++) {
+        for (int i = 0; i < 4; i++) {
+            cases[i].options.threads = 1;
+            cases[i].options.quiet = true;
+            unsigned long few = renderAllocations(callees[c].function, 1000, cases[i].options);
+            unsigned long many = renderAllocations(callees[c].function, 100000, cases[i].options);
+            bool ok = many <= few + SLACK;
+            printf("alloc_check %-9s %-20s 1000 calls: %lu allocations, 100000 calls: %lu allocations %s\n", callees[c].name,
+                   cases[i].name, few, many, ok ? "ok" : "FAILED");
+            failed += !ok;
+        }
+    }
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,115 @@
+#!/usr/bin/env python3
+"""Fit the time model of `LogoCompiler --estimate` to measured renders.
+
+    calibrate_cost.py LogoCompiler program.logo... [--runs R] [-- render options]
+
+Every program is estimated, then rendered R times; the fastest render is fitted
+by least squares as
+
+    START_MS + (program ops * NS_PER_PROGRAM_OP + (ops - off canvas) * NS_PER_OP + (calls - off canvas) * NS_PER_CALL
+                + ops off the canvas * NS_PER_OFF_CANVAS_OP + pixel writes on the canvas * NS_PER_PIXEL
+                + canvas bytes * NS_PER_CANVAS_BYTE) / 1e6
+
+Prints the constants for src/CostEstimator.cpp and the predicted and measured
+time of every program. Programs that fail, are unbounded or use @SIZE AUTO are
+left out.
+"""
+import argparse
+import os
+import re
+import subprocess
+import sys
+import tempfile
+import time
+
+FEATURES = ["program ops", "estimated ops", "estimated calls", "pixel writes on the canvas", "canvas",
+            "ops in calls off the canvas", "calls in calls off the canvas"]
+NAMES = ["START_MS", "NS_PER_PROGRAM_OP", "NS_PER_OP", "NS_PER_CALL", "NS_PER_OFF_CANVAS_OP", "NS_PER_PIXEL",
+         "NS_PER_CANVAS_BYTE"]
+
+
+def estimate(binary, program):
+    out = subprocess.run([binary, program, "--estimate"], capture_output=True, text=True)
+    if out.returncode != 0 or "at least" in out.stdout:
+        return None
+    values = {}
+    for line in out.stdout.splitlines():
+        key, _, rest = line.partition(": ")
+        number = re.match(r"[0-9.]+", rest)
+        if key in FEATURES and number:
+            values[key] = float(number.group(0))
+    if len(values) != len(FEATURES):
+        return None
+    return [values[key] for key in FEATURES]
+
+
+def measure(binary, program, runs, options):
+    output = os.path.join(tempfile.gettempdir(), "calibrate-%d.bmp" % os.getpid())
+    best = None
+    for _ in range(runs):
+        start = time.perf_counter()
+        out = subprocess.run([binary, program, "-o", output] + options, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+        elapsed = (time.perf_counter() - start) * 1e3
+        if out.returncode != 0:
+            return None
+        best = elapsed if best is None else min(best, elapsed)
+    if os.path.exists(output):
+        os.unlink(output)
+    return best
+
+
+def solve(rows, targets):
+    """Least squares by the normal equations, small enough for Gauss-Jordan."""
+    n = len(rows[0])
+    a = [[sum(r[i] * r[j] for r in rows) for j in range(n)] + [sum(r[i] * t for r, t in zip(rows, targets))] for i in range(n)]
+    for c in range(n):
+        pivot = max(range(c, n), key=lambda r: abs(a[r][c]))
+        a[c], a[pivot] = a[pivot], a[c]
+        if a[c][c] == 0:
+            raise ValueError("the programs do not tell the terms apart, add more varied ones")
+        for r in range(n):
+            if r != c:
+                f = a[r][c] / a[c][c]
+                a[r] = [x - f * y for x, y in zip(a[r], a[c])]
+    return [a[i][n] / a[i][i] for i in range(n)]
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("binary")
+    parser.add_argument("programs", nargs="+")
+    parser.add_argument("--runs", type=int, default=5)
+    args, options = parser.parse_known_args()
+    options = [o for o in options if o != "--"]
+
+    rows, targets, names = [], [], []
+    for program in args.programs:
+        features = estimate(args.binary, program)
+        if features is None:
+            continue
+        elapsed = measure(args.binary, program, args.runs, options)
+        if elapsed is None:
+            continue
+        # in ms, like the measurement: 1, then ns of each term; the culled calls
+        # are summarized rather than run, they have their own term
+        programOps, ops, calls, pixels, canvas, offOps, offCalls = features
+        rows.append([1.0] + [f / 1e6 for f in (programOps, ops - offOps, calls - offCalls, offOps, pixels, canvas)])
+        targets.append(elapsed)
+        names.append(program)
+    if len(rows) < len(NAMES):
+        sys.exit("need at least %d programs that render" % len(NAMES))
+    # weighted by 1 / sqrt(time), between the absolute error, where the slowest
+    # programs decide alone, and the relative one, where the start-up does
+    weights = [1.0 / max(t, 1.0) ** 0.5 for t in targets]
+    coefficients = solve([[x * w for x in r] for r, w in zip(rows, weights)], [t * w for t, w in zip(targets, weights)])
+    for name, value in zip(NAMES, coefficients):
+        print("%-20s %.3g" % (name, value))
+    print()
+    print("%-40s %10s %10s" % ("program", "predicted", "measured"))
+    for name, row, measured in zip(names, rows, targets):
+        predicted = sum(c * x for c, x in zip(coefficients, row))
+        print("%-40s %8.1fms %8.1fms" % (os.path.basename(name), predicted, measured))
+
+
+if __name__ == "__main__":
+    main()
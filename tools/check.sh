@@ -0,0 +1,94 @@
+#!/bin/sh
+# The test cases that need options or several files, which running each
+# .logo of testcases/ on its own does not cover. Run by `make check` in src/:
+#
+#     check.sh ./LogoCompiler
+#
+# Every check runs in a scratch directory and prints ok or FAILED; the exit
+# status is the number of checks that failed.
+compiler=$(cd "$(dirname "$1")" && pwd)/$(basename "$1")
+cases=$(cd "$(dirname "$0")/../testcases" && pwd)
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+cd "$work" || exit 1
+failed=0
+
+# expect NAME STATUS TEXT COMMAND...: COMMAND exits with STATUS and prints TEXT
+expect() {
+    name=$1
+    status=$2
+    text=$3
+    shift 3
+    output=$("$@" 2>&1)
+    actual=$?
+    if [ "$actual" -eq "$status" ] && printf '%s\n' "$output" | grep -qF -- "$text"; then
+        echo "check $name ok"
+    else
+        echo "check $name FAILED: exit status $actual, expected $status and \"$text\" in:"
+        printf '%s\n' "$output" | sed 's/^/    /'
+        failed=$((failed + 1))
+    fi
+}
+
+# same NAME FILE EXPECTED: FILE has the bytes of EXPECTED
+same() {
+    if cmp -s "$2" "$3"; then
+        echo "check $1 ok"
+    else
+        echo "check $1 FAILED: $2 differs from $3"
+        failed=$((failed + 1))
+    fi
+}
+
+# a program that runs out of memory fails alone in a batch; the address space
+# is limited so that it fails the same way whatever the system overcommits
+batch() {
+    (ulimit -v 4000000 && exec "$compiler" "$@")
+}
+cp "$cases/basic/testcase_1.logo" first.logo
+cp "$cases/basic/testcase_1.logo" last.logo
+cp "$cases/errorcases/testcase_9.logo" big.logo
+expect "batch out of memory" 1 "failed big.logo: Error: out of memory" batch first.logo big.logo last.logo
+expect "batch goes on" 1 "batch: 2 ok, 1 failed" batch first.logo big.logo last.logo
+
+# every resource limit stops its program, whatever the optimizer and the
+# culler skip or merge
+limit() {
+    file=$1
+    text=$2
+    shift 2
+    cp "$cases/errorcases/$file" "$file"
+    for flags in "" "--no-cull" "--no-opt" "--no-opt --no-cull"; do
+        expect "$file $* $flags" 1 "$text" "$compiler" "$@" $flags "$file"
+    done
+}
+limit testcase_10.logo "Limit Error: the canvas needs 36000000 bytes" --max-canvas 16
+limit testcase_11.logo "Limit Error: more than 10000 ops executed" --max-ops 10000
+limit testcase_12.logo "Limit Error: more than 1000 pixels drawn" --max-pixels 1000
+limit testcase_13.logo "Limit Error: calls nested deeper than 10" --max-depth 10
+limit testcase_14.logo "Limit Error: still running after 20 ms" --time-limit 20
+expect "testcase_12.logo --max-pixels 4000" 0 "write to file" "$compiler" --max-pixels 4000 testcase_12.logo
+
+# an image that does not fit on the disk is an error, in a batch too
+if [ -w /dev/full ]; then
+    expect "bmp to a full disk" 1 "cannot write to file /dev/full" "$compiler" -o /dev/full first.logo
+    expect "svg to a full disk" 1 "cannot write to file /dev/full" "$compiler" --svg -o /dev/full first.logo
+    printf 'first.logo /dev/full\nlast.logo\n' > full.txt
+    expect "batch to a full disk" 1 "batch: 1 ok, 1 failed" "$compiler" --batch full.txt
+fi
+
+# a program read back from its bytecode renders the image of its text; a
+# truncated file and one of another version are refused
+for t in 10 14; do
+    cp "$cases/extended/testcase_$t.logo" bytecode_$t.logo
+    expect "testcase_$t.logo --emit-bytecode" 0 "write to file bytecode_$t.logoc" "$compiler" --emit-bytecode bytecode_$t.logoc bytecode_$t.logo
+    expect "testcase_$t.logoc" 0 "write to file bytecode_$t.bmp" "$compiler" bytecode_$t.logoc
+    same "testcase_$t.logoc image" bytecode_$t.bmp "$cases/extended/testcase_$t.bmp"
+done
+# the emitted renderer compiles without a warning, whichever helpers it calls
+expect "testcase_1.logo --emit-cpp" 0 "write to file emitted.cpp" "$compiler" --emit-cpp emitted.cpp first.logo
+expect "emitted.cpp -Wall -Wextra" 0 "" ${CXX:-g++} -std=c++11 -Wall -Wextra -Werror -c emitted.cpp -o emitted.o
+expect "testcase_15.logoc" 1 "Error: the file is not valid bytecode" "$compiler" "$cases/errorcases/testcase_15.logoc"
+expect "testcase_16.logoc" 1 "Error: the file is bytecode version 2, this compiler reads version 1" "$compiler" "$cases/errorcases/testcase_16.logoc"
+
+exit $failed
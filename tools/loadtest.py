@@ -0,0 +1,80 @@
+#!/usr/bin/env python3
+"""Measure the latency and throughput of a `LogoCompiler --serve SOCKET` daemon.
+
+    loadtest.py SOCKET program.logo... [--clients C] [--requests N] [-- daemon options]
+
+C clients each keep one connection open and send their share of N requests,
+going round the given programs. Every image is sent back over the socket.
+Reports the p50, p99 and maximum latency and the requests per second.
+"""
+import argparse
+import os
+import sys
+import threading
+import time
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+from logo_client import LogoClient  # noqa: E402
+
+
+def percentile(sorted_values, p):
+    index = min(len(sorted_values) - 1, max(0, int(round(p / 100.0 * len(sorted_values))) - 1))
+    return sorted_values[index]
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("socket")
+    parser.add_argument("programs", nargs="+")
+    parser.add_argument("--clients", type=int, default=4)
+    parser.add_argument("--requests", type=int, default=200)
+    args, options = parser.parse_known_args()
+    options = [o for o in options if o != "--"]
+
+    sources = []
+    for name in args.programs:
+        with open(name, "rb") as f:
+            sources.append(f.read())
+
+    latencies = []
+    failures = []
+    lock = threading.Lock()
+
+    def client(index):
+        connection = LogoClient(args.socket)
+        mine = []
+        errors = []
+        try:
+            for i in range(index, args.requests, args.clients):
+                start = time.perf_counter()
+                ok, result = connection.render(sources[i % len(sources)], options)
+                mine.append(time.perf_counter() - start)
+                if not ok:
+                    errors.append(result)
+        finally:
+            connection.close()
+        with lock:
+            latencies.extend(mine)
+            failures.extend(errors)
+
+    threads = [threading.Thread(target=client, args=(i,)) for i in range(args.clients)]
+    start = time.perf_counter()
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+    elapsed = time.perf_counter() - start
+
+    latencies.sort()
+    ms = [x * 1000 for x in latencies]
+    print("%d requests, %d clients, %d failed" % (len(ms), args.clients, len(failures)))
+    print("latency ms: p50 %.2f  p99 %.2f  max %.2f" % (percentile(ms, 50), percentile(ms, 99), ms[-1]))
+    print("throughput: %.1f requests/s" % (len(ms) / elapsed))
+    if failures:
+        print("first error: " + failures[0], file=sys.stderr)
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
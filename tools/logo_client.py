@@ -0,0 +1,69 @@
+#!/usr/bin/env python3
+"""Render a Logo program with a running `LogoCompiler --serve SOCKET` daemon.
+
+    logo_client.py SOCKET program.logo [-o out.bmp] [-- daemon options]
+
+The image is sent back over the socket and written next to the program, or
+to the path given with -o; the daemon itself writes no file.
+"""
+import argparse
+import os
+import socket
+import sys
+
+
+class LogoClient:
+    """One connection to the daemon, reused for any number of requests."""
+
+    def __init__(self, path):
+        self.sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        self.sock.connect(path)
+        self.reader = self.sock.makefile("rb")
+
+    def close(self):
+        self.reader.close()
+        self.sock.close()
+
+    def render(self, source, options=()):
+        """Return (True, image bytes) or (False, error text)."""
+        if isinstance(source, str):
+            source = source.encode()
+        header = " ".join(["RENDER", str(len(source))] + list(options))
+        self.sock.sendall(header.encode() + b"\n" + source)
+        status = self.reader.readline().decode().split()
+        if not status:
+            raise ConnectionError("the daemon closed the connection")
+        body = self.reader.read(int(status[1]))
+        if status[0] == "OK":
+            return True, body
+        return False, body.decode()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("socket")
+    parser.add_argument("program")
+    parser.add_argument("-o", dest="output")
+    args, options = parser.parse_known_args()
+    options = [o for o in options if o != "--"]
+
+    with open(args.program, "rb") as f:
+        source = f.read()
+    client = LogoClient(args.socket)
+    try:
+        ok, result = client.render(source, options)
+        output = args.output or os.path.splitext(args.program)[0] + (".svg" if "--svg" in options else ".bmp")
+        if ok:
+            with open(output, "wb") as f:
+                f.write(result)
+    finally:
+        client.close()
+    if not ok:
+        print(result, file=sys.stderr)
+        return 1
+    print("write to file " + output)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())